@@ -0,0 +1,59 @@
+/* skip_diag.h - sock_diag interface of AF_SKIP sockets */
+
+#ifndef _SKIP_DIAG_H_
+#define _SKIP_DIAG_H_
+
+#include <linux/types.h>
+
+
+/* request, sent with sdiag_family AF_SKIP on NETLINK_SOCK_DIAG.
+ * Only dump (NLM_F_DUMP) is supported. */
+struct skip_diag_req {
+	__u8	sdiag_family;	/* AF_SKIP */
+	__u8	sdiag_protocol;	/* IPPROTO_TCP/UDP, 0 for all */
+	__u16	pad;
+	__u32	sdiag_states;	/* bitmask of TCP states of the host socket */
+};
+
+enum {
+	SKIP_DIAG_REQ_NONE,
+	SKIP_DIAG_REQ_BYTECODE,	/* inet_diag bytecode, on the host socket */
+	__SKIP_DIAG_REQ_MAX,
+};
+
+#define SKIP_DIAG_REQ_MAX	(__SKIP_DIAG_REQ_MAX - 1)
+
+
+/* reply */
+struct skip_diag_msg {
+	__u8	sdiag_family;	/* AF_SKIP */
+	__u8	sdiag_type;
+	__u8	sdiag_protocol;
+	__u8	sdiag_state;	/* of the host socket, TCP_CLOSE if none */
+	__u32	sdiag_ino;	/* of the skip socket */
+	__u32	sdiag_cookie[2];
+};
+
+/* virtual address the skip socket is bound to */
+struct skip_diag_addr {
+	__u8	family;
+	__u8	pad;
+	__be16	port;
+	__be32	addr[4];
+};
+
+enum {
+	SKIP_DIAG_UNSPEC,
+
+	SKIP_DIAG_NETNSID,	/* s32: of the skip socket, seen from the
+				 * requester. -1 if not assigned */
+	SKIP_DIAG_VADDR,	/* struct skip_diag_addr */
+	SKIP_DIAG_HOST,		/* struct inet_diag_msg of the host socket */
+	SKIP_DIAG_FANIN,	/* u32: host sockets of a wildcard bind */
+
+	__SKIP_DIAG_MAX,
+};
+
+#define SKIP_DIAG_MAX	(__SKIP_DIAG_MAX - 1)
+
+#endif
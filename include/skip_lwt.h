@@ -8,21 +8,65 @@
 
 #include <net/lwtunnel.h>
 
-/* skip lwtunnel state structure */
-struct skip_lwt {
-	int		dst_family;
-	__be32		dst_addr4;
-	struct in6_addr dst_addr6;
-
+struct skip_stats;
+struct skip_addr_list;
+
+/* inbound/outbound flags of a route, compiled at build_state and
+ * cached on the sockets bound through it. A route with neither flag
+ * permits both, as before the flags were enforced. */
+#define SKIP_POLICY_INBOUND	0x01	/* listen() and accept() */
+#define SKIP_POLICY_OUTBOUND	0x02	/* connect() */
+#define SKIP_POLICY_ANY		(SKIP_POLICY_INBOUND | SKIP_POLICY_OUTBOUND)
+
+/* host side of skip routes. Routes with the same configuration in
+ * a netns share one, interned by skip_build_state(). It is immutable
+ * after that, and the counters stay per route (struct skip_lwt). */
+struct skip_host {
 	int		host_family;
 	__be32		host_addr4;
 	struct in6_addr	host_addr6;
 
 	bool inbound;
 	bool outbound;
+	u8 policy;	/* SKIP_POLICY_* */
 
 	bool v4v6map;
 	struct in6_addr map_prefix;
+
+	bool handoff;	/* hand the host socket over to the user */
+
+	bool packet;	/* redirect packets into host_net */
+
+	/* source address pool for connect(), host_addr is the
+	 * first. NULL for a single host address. */
+	struct skip_addr_list *addr_list;
+
+	/* netns of the host sockets, referenced. NULL for init_net */
+	struct net *host_net;
+
+	/* intern table (skip_lwt.c), under skip_host_lock */
+	struct hlist_node	hnode;
+	struct net		*net;	/* of the routes */
+	u32			hash;
+	unsigned int		refcnt;	/* routes sharing this */
+	struct rcu_head		rcu;
+};
+
+/* skip lwtunnel state structure */
+struct skip_lwt {
+	int		dst_family;
+	__be32		dst_addr4;
+	struct in6_addr dst_addr6;
+
+	struct skip_host *host;
+
+	struct skip_stats *stats;	/* per-cpu counters of this route */
+
+	/* per-netns prefix table (skip_lwt.c) */
+	struct hlist_node	hnode;
+	struct net		*net;
+	int			dst_len;
+	bool			linked;
 };
 
 static inline struct skip_lwt *skip_lwt_lwtunnel(struct lwtunnel_state *lwt)
@@ -30,6 +74,11 @@ static inline struct skip_lwt *skip_lwt_lwtunnel(struct lwtunnel_state *lwt)
         return (struct skip_lwt *)lwt->data;
 }
 
+static inline struct net *skip_lwt_host_net(struct skip_lwt *slwt)
+{
+	return slwt->host->host_net ? slwt->host->host_net : &init_net;
+}
+
 #endif	/* __KERNEL__ */
 
 
@@ -51,10 +100,59 @@ enum {
 	SKIP_ATTR_MAP_V4V6,		/* u8: true 1, false 0 */
 	SKIP_ATTR_MAP_PREFIX,		/* binary 128bit */
 
+	SKIP_ATTR_HANDOFF,		/* u8: true 1, false 0 */
+
+	SKIP_ATTR_STATS,		/* nested SKIP_STATS_*, dump only */
+	SKIP_ATTR_PAD,
+
+	SKIP_ATTR_HOST_ADDR_LIST,	/* nested SKIP_ATTR_HOST_ADDR4 or
+					 * ADDR6, source address pool */
+
+	SKIP_ATTR_NETNS_ID,		/* s32: nsid of the netns of host
+					 * sockets, init_net if absent */
+	SKIP_ATTR_NETNS_FD,		/* u32: fd of it, set only */
+
+	SKIP_ATTR_SHARED,		/* u32: routes sharing the host
+					 * state, dump only */
+
+	SKIP_ATTR_PACKET,		/* u8: true 1, false 0. redirect
+					 * packets into the netns of host
+					 * sockets */
+
 	__SKIP_ATTR_MAX,
 };
 
 #define SKIP_ATTR_MAX	(__SKIP_ATTR_MAX - 1)
 
+/* max number of addresses in SKIP_ATTR_HOST_ADDR_LIST */
+#define SKIP_HOST_ADDR_LIST_MAX	16
+
+/* counters of a skip route */
+enum {
+	SKIP_STATS_UNSPEC,
+
+	SKIP_STATS_BIND,		/* u64: sockets bound */
+	SKIP_STATS_CONNECT,		/* u64: connect() */
+	SKIP_STATS_ACCEPT,		/* u64: accept() */
+	SKIP_STATS_TX_PACKETS,		/* u64: sendmsg/sendpage calls */
+	SKIP_STATS_TX_BYTES,		/* u64 */
+	SKIP_STATS_RX_PACKETS,		/* u64: recvmsg/splice calls */
+	SKIP_STATS_RX_BYTES,		/* u64 */
+	SKIP_STATS_LOOKUP_FAIL,		/* u64: resolved but host failed */
+
+	SKIP_STATS_PAD,
+
+	SKIP_STATS_REJECT_INBOUND,	/* u64: listen/accept not permitted */
+	SKIP_STATS_REJECT_OUTBOUND,	/* u64: connect not permitted */
+
+	SKIP_STATS_PKT_OUTPUT,		/* u64: local packets redirected */
+	SKIP_STATS_PKT_INPUT,		/* u64: forwarded packets redirected */
+	SKIP_STATS_PKT_DROP,		/* u64: packets failed to redirect */
+
+	__SKIP_STATS_MAX,
+};
+
+#define SKIP_STATS_MAX	(__SKIP_STATS_MAX - 1)
+
 
 #endif
@@ -0,0 +1 @@
+../../include/af_skip.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../include/skip_diag.h
\ No newline at end of file
@@ -25,6 +25,7 @@
 #include "utils.h"
 #include "iproute_lwtunnel.h"
 #include "bpf_util.h"
+#include "namespace.h"
 
 #include "skip_lwt.h"
 
@@ -224,6 +225,55 @@ static void print_encap_bpf(FILE *fp, struct rtattr *encap)
 		fprintf(fp, "%d ", rta_getattr_u32(tb[LWT_BPF_XMIT_HEADROOM]));
 }
 
+static void print_encap_skip_stats(FILE *fp, struct rtattr *attr)
+{
+	int i;
+	struct rtattr *tb[SKIP_STATS_MAX+1];
+	static const char * const names[SKIP_STATS_MAX+1] = {
+		[SKIP_STATS_BIND]	= "bind",
+		[SKIP_STATS_CONNECT]	= "connect",
+		[SKIP_STATS_ACCEPT]	= "accept",
+		[SKIP_STATS_TX_PACKETS]	= "tx_packets",
+		[SKIP_STATS_TX_BYTES]	= "tx_bytes",
+		[SKIP_STATS_RX_PACKETS]	= "rx_packets",
+		[SKIP_STATS_RX_BYTES]	= "rx_bytes",
+		[SKIP_STATS_LOOKUP_FAIL] = "lookup_fail",
+		[SKIP_STATS_REJECT_INBOUND] = "reject_inbound",
+		[SKIP_STATS_REJECT_OUTBOUND] = "reject_outbound",
+		[SKIP_STATS_PKT_OUTPUT]	= "pkt_output",
+		[SKIP_STATS_PKT_INPUT]	= "pkt_input",
+		[SKIP_STATS_PKT_DROP]	= "pkt_drop",
+	};
+
+	parse_rtattr_nested(tb, SKIP_STATS_MAX, attr);
+
+	fprintf(fp, "stats ");
+	for (i = 1; i <= SKIP_STATS_MAX; i++) {
+		if (!names[i] || !tb[i])
+			continue;
+		fprintf(fp, "%s %llu ", names[i],
+			(unsigned long long)rta_getattr_u64(tb[i]));
+	}
+}
+
+static void print_encap_skip_addr_list(FILE *fp, int family,
+				       struct rtattr *attr)
+{
+	/* the rest of the pool, the first one is the host address */
+
+	int rem, n = 0;
+	char buf[64];
+	struct rtattr *i;
+
+	for (i = RTA_DATA(attr), rem = RTA_PAYLOAD(attr); RTA_OK(i, rem);
+	     i = RTA_NEXT(i, rem)) {
+		if (n++ == 0)
+			continue;
+		fprintf(fp, ",%s",
+			inet_ntop(family, RTA_DATA(i), buf, sizeof(buf)));
+	}
+}
+
 static void print_encap_skip(FILE *fp, struct rtattr *encap)
 {
 	int family;
@@ -240,7 +290,11 @@ static void print_encap_skip(FILE *fp, struct rtattr *encap)
 				      SKIP_ATTR_HOST_ADDR4 :
 				      SKIP_ATTR_HOST_ADDR6]),
 			  buf, sizeof(buf));
-		fprintf(fp, "host %s ", buf);
+		fprintf(fp, "host %s", buf);
+		if (tb[SKIP_ATTR_HOST_ADDR_LIST])
+			print_encap_skip_addr_list(fp, family,
+						   tb[SKIP_ATTR_HOST_ADDR_LIST]);
+		fprintf(fp, " ");
 	}
 	
 	/* inbound/outbound */
@@ -252,9 +306,32 @@ static void print_encap_skip(FILE *fp, struct rtattr *encap)
 
 	/* v4v6 mapping */
 	if (tb[SKIP_ATTR_MAP_V4V6] && rta_getattr_u8(tb[SKIP_ATTR_MAP_V4V6])) {
-		fprintf(fp, "map %s",
+		fprintf(fp, "map %s ",
 			rt_addr_n2a_rta(AF_INET6, tb[SKIP_ATTR_MAP_PREFIX]));
 	}
+
+	/* socket handoff */
+	if (tb[SKIP_ATTR_HANDOFF] && rta_getattr_u8(tb[SKIP_ATTR_HANDOFF]))
+		fprintf(fp, "handoff ");
+
+	/* packet mode */
+	if (tb[SKIP_ATTR_PACKET] && rta_getattr_u8(tb[SKIP_ATTR_PACKET]))
+		fprintf(fp, "packet ");
+
+	/* netns of host sockets */
+	if (tb[SKIP_ATTR_NETNS_ID])
+		fprintf(fp, "netnsid %d ",
+			(int)rta_getattr_u32(tb[SKIP_ATTR_NETNS_ID]));
+
+	/* routes sharing the host state and counters */
+	if (show_details && tb[SKIP_ATTR_SHARED] &&
+	    rta_getattr_u32(tb[SKIP_ATTR_SHARED]) > 1)
+		fprintf(fp, "shared %u ",
+			rta_getattr_u32(tb[SKIP_ATTR_SHARED]));
+
+	/* counters */
+	if (show_stats && tb[SKIP_ATTR_STATS])
+		print_encap_skip_stats(fp, tb[SKIP_ATTR_STATS]);
 }
 
 void lwt_print_encap(FILE *fp, struct rtattr *encap_type,
@@ -592,15 +669,60 @@ static int parse_encap_bpf(struct rtattr *rta, size_t len, int *argcp,
 static void lwt_skip_usage(void)
 {
 	fprintf(stderr,
-		"Usage: ip route ... encap skip [ host ADDRESS ] "
-		"[ inbound ] [ outbound ] [ map V4V6MAP_6PREFIX ]\n");
+		"Usage: ip route ... encap skip [ host ADDRESS[,ADDRESS...] ] "
+		"[ inbound ] [ outbound ] [ map V4V6MAP_6PREFIX ] "
+		"[ handoff ] [ netns NAME | netnsid ID ] [ packet ]\n");
 		exit(-1);
 }
 
+static void parse_encap_skip_host(struct rtattr *rta, size_t len,
+				  char *arg)
+{
+	/* ADDRESS[,ADDRESS...]: the first one is the host address,
+	 * and all of them make the source address pool */
+
+	int n, count = 0;
+	char *addr, *next;
+	inet_prefix addrs[SKIP_HOST_ADDR_LIST_MAX];
+	struct rtattr *nest;
+
+	for (addr = arg; addr; addr = next) {
+		next = strchr(addr, ',');
+		if (next)
+			*next++ = '\0';
+
+		if (count == SKIP_HOST_ADDR_LIST_MAX)
+			invarg("too many host addresses", addr);
+		if (get_addr(&addrs[count], addr, AF_UNSPEC) ||
+		    (addrs[count].family != AF_INET &&
+		     addrs[count].family != AF_INET6) ||
+		    (count && addrs[count].family != addrs[0].family))
+			invarg("invalid host address", addr);
+		count++;
+	}
+
+	rta_addattr32(rta, len, SKIP_ATTR_HOST_ADDR_FAMILY, addrs[0].family);
+	if (addrs[0].family == AF_INET)
+		rta_addattr32(rta, len, SKIP_ATTR_HOST_ADDR4, addrs[0].data[0]);
+	else
+		rta_addattr_l(rta, len, SKIP_ATTR_HOST_ADDR6,
+			      addrs[0].data, addrs[0].bytelen);
+
+	if (count == 1)
+		return;
+
+	nest = rta_nest(rta, len, SKIP_ATTR_HOST_ADDR_LIST);
+	for (n = 0; n < count; n++)
+		rta_addattr_l(rta, len,
+			      addrs[n].family == AF_INET ?
+			      SKIP_ATTR_HOST_ADDR4 : SKIP_ATTR_HOST_ADDR6,
+			      addrs[n].data, addrs[n].bytelen);
+	rta_nest_end(rta, nest);
+}
+
 static int parse_encap_skip(struct rtattr *rta, size_t len,
 			    int *argcp, char ***argvp)
 {
-	__be32 addr4;
 	struct in6_addr addr6;
 
 	int argc = *argcp;
@@ -611,21 +733,7 @@ static int parse_encap_skip(struct rtattr *rta, size_t len,
 		if (strcmp(*argv, "host") == 0) {
 
 			NEXT_ARG();
-			if(inet_pton(AF_INET, *argv, &addr4)) {
-				rta_addattr32(rta, len,
-					      SKIP_ATTR_HOST_ADDR_FAMILY,
-					      AF_INET);
-				rta_addattr32(rta, len, SKIP_ATTR_HOST_ADDR4,
-					      addr4);
-			} else if (inet_pton(AF_INET6, *argv, &addr6)) {
-				rta_addattr32(rta, len,
-					      SKIP_ATTR_HOST_ADDR_FAMILY,
-					      AF_INET6);
-				rta_addattr_l(rta, len, SKIP_ATTR_HOST_ADDR6,
-					      &addr6, sizeof(addr6));
-			} else {
-				invarg("invalid host address", *argv);
-			}
+			parse_encap_skip_host(rta, len, *argv);
 
 		} else if (strcmp(*argv, "inbound") == 0) {
 
@@ -646,6 +754,31 @@ static int parse_encap_skip(struct rtattr *rta, size_t len,
 				invarg("invalid prefix for v4v6 mapping\n",
 					*argv);
 			}
+		} else if (strcmp(*argv, "handoff") == 0) {
+
+			rta_addattr8(rta, len, SKIP_ATTR_HANDOFF, 1);
+
+		} else if (strcmp(*argv, "packet") == 0) {
+
+			rta_addattr8(rta, len, SKIP_ATTR_PACKET, 1);
+
+		} else if (strcmp(*argv, "netns") == 0) {
+			int fd;
+
+			NEXT_ARG();
+			fd = netns_get_fd(*argv);
+			if (fd < 0)
+				invarg("invalid netns name", *argv);
+			rta_addattr32(rta, len, SKIP_ATTR_NETNS_FD, fd);
+
+		} else if (strcmp(*argv, "netnsid") == 0) {
+			__s32 nsid;
+
+			NEXT_ARG();
+			if (get_s32(&nsid, *argv, 0) || nsid < 0)
+				invarg("invalid netnsid", *argv);
+			rta_addattr32(rta, len, SKIP_ATTR_NETNS_ID, nsid);
+
 		} else if (strcmp(*argv, "help") == 0) {
 			lwt_skip_usage();
 		}
@@ -45,6 +45,9 @@
 #include <linux/netlink_diag.h>
 #include <linux/sctp.h>
 
+#include "af_skip.h"
+#include "skip_diag.h"
+
 #define MAGIC_SEQ 123456
 
 #define DIAG_REQUEST(_req, _r)						    \
@@ -126,6 +129,7 @@ enum {
 	PACKET_R_DB,
 	NETLINK_DB,
 	SCTP_DB,
+	SKIP_DB,
 	MAX_DB
 };
 
@@ -220,6 +224,10 @@ static const struct filter default_dbs[MAX_DB] = {
 		.states   = SS_CONN,
 		.families = (1 << AF_INET) | (1 << AF_INET6),
 	},
+	[SKIP_DB] = {
+		.states   = SS_CONN,
+		.families = (1 << AF_SKIP),
+	},
 };
 
 static const struct filter default_afs[AF_MAX] = {
@@ -243,6 +251,10 @@ static const struct filter default_afs[AF_MAX] = {
 		.dbs    = (1 << NETLINK_DB),
 		.states = (1 << SS_CLOSE),
 	},
+	[AF_SKIP] = {
+		.dbs    = (1 << SKIP_DB),
+		.states = SS_CONN,
+	},
 };
 
 static int do_default = 1;
@@ -2340,14 +2352,9 @@ static void sctp_show_info(const struct nlmsghdr *nlh, struct inet_diag_msg *r,
 	}
 }
 
-static void parse_diag_msg(struct nlmsghdr *nlh, struct sockstat *s)
+static void parse_diag_msg_common(const struct inet_diag_msg *r,
+				  struct sockstat *s)
 {
-	struct rtattr *tb[INET_DIAG_MAX+1];
-	struct inet_diag_msg *r = NLMSG_DATA(nlh);
-
-	parse_rtattr(tb, INET_DIAG_MAX, (struct rtattr *)(r+1),
-		     nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
-
 	s->state	= r->idiag_state;
 	s->local.family	= s->remote.family = r->idiag_family;
 	s->lport	= ntohs(r->id.idiag_sport);
@@ -2359,14 +2366,6 @@ static void parse_diag_msg(struct nlmsghdr *nlh, struct sockstat *s)
 	s->iface	= r->id.idiag_if;
 	s->sk		= cookie_sk_get(&r->id.idiag_cookie[0]);
 
-	s->mark = 0;
-	if (tb[INET_DIAG_MARK])
-		s->mark = *(__u32 *) RTA_DATA(tb[INET_DIAG_MARK]);
-	if (tb[INET_DIAG_PROTOCOL])
-		s->raw_prot = *(__u8 *)RTA_DATA(tb[INET_DIAG_PROTOCOL]);
-	else
-		s->raw_prot = 0;
-
 	if (s->local.family == AF_INET)
 		s->local.bytelen = s->remote.bytelen = 4;
 	else
@@ -2376,6 +2375,25 @@ static void parse_diag_msg(struct nlmsghdr *nlh, struct sockstat *s)
 	memcpy(s->remote.data, r->id.idiag_dst, s->local.bytelen);
 }
 
+static void parse_diag_msg(struct nlmsghdr *nlh, struct sockstat *s)
+{
+	struct rtattr *tb[INET_DIAG_MAX+1];
+	struct inet_diag_msg *r = NLMSG_DATA(nlh);
+
+	parse_rtattr(tb, INET_DIAG_MAX, (struct rtattr *)(r+1),
+		     nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
+
+	parse_diag_msg_common(r, s);
+
+	s->mark = 0;
+	if (tb[INET_DIAG_MARK])
+		s->mark = *(__u32 *) RTA_DATA(tb[INET_DIAG_MARK]);
+	if (tb[INET_DIAG_PROTOCOL])
+		s->raw_prot = *(__u8 *)RTA_DATA(tb[INET_DIAG_PROTOCOL]);
+	else
+		s->raw_prot = 0;
+}
+
 static int inet_show_sock(struct nlmsghdr *nlh,
 			  struct sockstat *s)
 {
@@ -3451,6 +3469,143 @@ static int packet_show(struct filter *f)
 	return rc;
 }
 
+static int skip_show_sock(const struct sockaddr_nl *addr,
+		struct nlmsghdr *nlh, void *arg)
+{
+	const struct filter *f = arg;
+	struct skip_diag_msg *r = NLMSG_DATA(nlh);
+	struct rtattr *tb[SKIP_DIAG_MAX+1];
+	struct sockstat s = {};
+	const char *sep = "";
+
+	parse_rtattr(tb, SKIP_DIAG_MAX, (struct rtattr *)(r+1),
+		     nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*r)));
+
+	if (tb[SKIP_DIAG_HOST]) {
+		parse_diag_msg_common(RTA_DATA(tb[SKIP_DIAG_HOST]), &s);
+	} else {
+		/* no host socket yet */
+		s.state = SS_CLOSE;
+		s.local.family = s.remote.family = AF_INET;
+		s.local.bytelen = s.remote.bytelen = 4;
+	}
+
+	/* processes own the skip socket, not the host socket */
+	s.type = r->sdiag_protocol;
+	s.ino = r->sdiag_ino;
+	s.sk = cookie_sk_get(&r->sdiag_cookie[0]);
+
+	if (!(f->states & (1 << s.state)))
+		return 0;
+	if (f->f && run_ssfilter(f->f, &s) == 0)
+		return 0;
+
+	inet_stats_print(&s);
+
+	printf(" skip:(");
+	if (tb[SKIP_DIAG_NETNSID] &&
+	    rta_getattr_u32(tb[SKIP_DIAG_NETNSID]) != (__u32)-1) {
+		printf("%snetnsid:%d", sep,
+		       (int)rta_getattr_u32(tb[SKIP_DIAG_NETNSID]));
+		sep = ",";
+	}
+	if (tb[SKIP_DIAG_VADDR]) {
+		struct skip_diag_addr *va = RTA_DATA(tb[SKIP_DIAG_VADDR]);
+
+		printf("%svaddr:%s:%u", sep,
+		       format_host(va->family,
+				   va->family == AF_INET6 ? 16 : 4, va->addr),
+		       ntohs(va->port));
+		sep = ",";
+	}
+	if (tb[SKIP_DIAG_FANIN]) {
+		printf("%sfanin:%u", sep,
+		       rta_getattr_u32(tb[SKIP_DIAG_FANIN]));
+		sep = ",";
+	}
+	if (!tb[SKIP_DIAG_HOST])
+		printf("%snohost", sep);
+	printf(")");
+
+	if (show_details)
+		sock_details_print(&s);
+
+	printf("\n");
+	return 0;
+}
+
+static int skip_show_netlink(struct filter *f)
+{
+	struct sockaddr_nl nladdr = { .nl_family = AF_NETLINK };
+	DIAG_REQUEST(req, struct skip_diag_req r);
+	struct rtnl_handle rth;
+	char    *bc = NULL;
+	int	bclen;
+	struct msghdr msg;
+	struct rtattr rta;
+	struct iovec iov[3];
+	int iovlen = 1;
+	int ret = -1;
+
+	req.r.sdiag_family = AF_SKIP;
+	req.r.sdiag_states = f->states;
+
+	iov[0] = (struct iovec){
+		.iov_base = &req,
+		.iov_len = sizeof(req)
+	};
+	if (f->f) {
+		/* runs on the host socket in the kernel */
+		bclen = ssfilter_bytecompile(f->f, &bc);
+		if (bclen) {
+			rta.rta_type = SKIP_DIAG_REQ_BYTECODE;
+			rta.rta_len = RTA_LENGTH(bclen);
+			iov[1] = (struct iovec){ &rta, sizeof(rta) };
+			iov[2] = (struct iovec){ bc, bclen };
+			req.nlh.nlmsg_len += RTA_LENGTH(bclen);
+			iovlen = 3;
+		}
+	}
+
+	msg = (struct msghdr) {
+		.msg_name = (void *)&nladdr,
+		.msg_namelen = sizeof(nladdr),
+		.msg_iov = iov,
+		.msg_iovlen = iovlen,
+	};
+
+	if (rtnl_open_byproto(&rth, 0, NETLINK_SOCK_DIAG)) {
+		free(bc);
+		return -1;
+	}
+	rth.dump = MAGIC_SEQ;
+
+	if (sendmsg(rth.fd, &msg, 0) < 0)
+		goto Exit;
+
+	if (rtnl_dump_filter(&rth, skip_show_sock, f))
+		goto Exit;
+
+	ret = 0;
+Exit:
+	rtnl_close(&rth);
+	free(bc);
+	return ret;
+}
+
+static int skip_show(struct filter *f)
+{
+	/* AF_SKIP sockets exist only with the skip module, and
+	 * sock_diag is the only way to find them */
+	if (skip_show_netlink(f)) {
+		fprintf(stderr, "ss: failed to dump AF_SKIP sockets, "
+			"is the skip module loaded?\n");
+		return -1;
+	}
+
+	return 0;
+}
+
 static int netlink_show_one(struct filter *f,
 				int prot, int pid, unsigned int groups,
 				int state, int dst_pid, unsigned int dst_group,
@@ -3880,6 +4035,7 @@ static void _usage(FILE *dest)
 "   -4, --ipv4          display only IP version 4 sockets\n"
 "   -6, --ipv6          display only IP version 6 sockets\n"
 "   -0, --packet        display PACKET sockets\n"
+"       --skip          display only AF_SKIP sockets\n"
 "   -t, --tcp           display only TCP sockets\n"
 "   -S, --sctp          display only SCTP sockets\n"
 "   -u, --udp           display only UDP sockets\n"
@@ -3893,7 +4049,7 @@ static void _usage(FILE *dest)
 "   -H, --no-header     Suppress header line\n"
 "\n"
 "   -A, --query=QUERY, --socket=QUERY\n"
-"       QUERY := {all|inet|tcp|udp|raw|unix|unix_dgram|unix_stream|unix_seqpacket|packet|netlink}[,QUERY]\n"
+"       QUERY := {all|inet|tcp|udp|raw|unix|unix_dgram|unix_stream|unix_seqpacket|packet|netlink|skip}[,QUERY]\n"
 "\n"
 "   -D, --diag=FILE     Dump raw information about TCP sockets to FILE\n"
 "   -F, --filter=FILE   read filter information from FILE\n"
@@ -3966,6 +4122,9 @@ static int scan_state(const char *state)
 	exit(-1);
 }
 
+/* long options without a short option */
+#define OPT_SKIP 256
+
 static const struct option long_opts[] = {
 	{ "numeric", 0, 0, 'n' },
 	{ "resolve", 0, 0, 'r' },
@@ -3987,6 +4146,7 @@ static const struct option long_opts[] = {
 	{ "ipv4", 0, 0, '4' },
 	{ "ipv6", 0, 0, '6' },
 	{ "packet", 0, 0, '0' },
+	{ "skip", 0, 0, OPT_SKIP },
 	{ "family", 1, 0, 'f' },
 	{ "socket", 1, 0, 'A' },
 	{ "query", 1, 0, 'A' },
@@ -4082,6 +4242,9 @@ int main(int argc, char *argv[])
 		case '0':
 			filter_af_set(&current_filter, AF_PACKET);
 			break;
+		case OPT_SKIP:
+			filter_db_set(&current_filter, SKIP_DB);
+			break;
 		case 'f':
 			if (strcmp(optarg, "inet") == 0)
 				filter_af_set(&current_filter, AF_INET);
@@ -4158,6 +4321,8 @@ int main(int argc, char *argv[])
 					filter_db_set(&current_filter, PACKET_DG_DB);
 				} else if (strcmp(p, "netlink") == 0) {
 					filter_db_set(&current_filter, NETLINK_DB);
+				} else if (strcmp(p, "skip") == 0) {
+					filter_db_set(&current_filter, SKIP_DB);
 				} else {
 					fprintf(stderr, "ss: \"%s\" is illegal socket table id\n", p);
 					usage();
@@ -4373,6 +4538,8 @@ int main(int argc, char *argv[])
 		tcp_show(&current_filter, IPPROTO_DCCP);
 	if (current_filter.dbs & (1<<SCTP_DB))
 		sctp_show(&current_filter);
+	if (current_filter.dbs & (1<<SKIP_DB))
+		skip_show(&current_filter);
 
 	if (show_users || show_proc_ctx || show_sock_ctx)
 		user_ent_destroy();
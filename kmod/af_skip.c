@@ -11,7 +11,19 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/socket.h>
+#include <linux/slab.h>
+#include <linux/fdtable.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/cred.h>
+#include <linux/hash.h>
+#include <linux/jhash.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
 #include <net/sock.h>
+#include <net/busy_poll.h>
+#include <net/compat.h>
+#include <net/ipv6.h>
 #include <net/dst.h>
 #include <net/route.h>
 #include <net/ip6_route.h>
@@ -28,359 +40,2410 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 
+static bool accept_vaddr = false;
+module_param(accept_vaddr, bool, 0644);
+MODULE_PARM_DESC(accept_vaddr, "keep accepted TCP sockets of listeners "
+		 "bound to virtual addresses as skip sockets, to show the "
+		 "virtual address by getsockname()");
 
-struct skip_sock {
-	struct sock sk;
 
-	bool bound;		/* bind() is called or not */
+/* setsockopt() called before the host socket is created. It is
+ * replayed to the host socket when it is created. */
+struct skip_sockopt {
+	struct list_head list;
 
-	struct socket *sock;	/* this socket */
+	int		level;
+	int		optname;
+	unsigned int	optlen;
+	char		optval[0];
+};
+
+#define SKIP_SOCKOPT_MAXLEN	256
+
+static inline bool skip_sockaddr_any(struct sockaddr *sa)
+{
+	switch (sa->sa_family) {
+	case AF_INET:
+		return ((struct sockaddr_in *)sa)->sin_addr.s_addr ==
+			htonl(INADDR_ANY);
+	case AF_INET6:
+		return ipv6_addr_any(&((struct sockaddr_in6 *)sa)->sin6_addr);
+	}
+
+	return false;
+}
+
+static inline __be16 skip_sockaddr_port(struct sockaddr *sa)
+{
+	if (sa->sa_family == AF_INET6)
+		return ((struct sockaddr_in6 *)sa)->sin6_port;
+	return ((struct sockaddr_in *)sa)->sin_port;
+}
+
+static inline void skip_sockaddr_set_port(struct sockaddr *sa, __be16 port)
+{
+	if (sa->sa_family == AF_INET6)
+		((struct sockaddr_in6 *)sa)->sin6_port = port;
+	else
+		((struct sockaddr_in *)sa)->sin_port = port;
+}
+
+static inline int skip_sockaddr_len(struct sockaddr *sa)
+{
+	return (sa->sa_family == AF_INET6) ?
+		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+static inline bool skip_inaddr_get(struct sockaddr *sa,
+				   union skip_inaddr *in)
+{
+	switch (sa->sa_family) {
+	case AF_INET:
+		in->a4 = ((struct sockaddr_in *)sa)->sin_addr.s_addr;
+		return true;
+	case AF_INET6:
+		in->a6 = ((struct sockaddr_in6 *)sa)->sin6_addr;
+		return true;
+	}
+
+	return false;
+}
+
+static bool skip_vmap_set(struct skip_vmap *vm, struct sockaddr *host,
+			  struct sockaddr *virt)
+{
+	/* false if there is nothing to translate */
+
+	memset(vm, 0, sizeof(*vm));
+	if (!skip_inaddr_get(host, &vm->host) ||
+	    !skip_inaddr_get(virt, &vm->virt))
+		return false;
+
+	vm->hfamily = host->sa_family;
+	vm->vfamily = virt->sa_family;
+
+	if (vm->hfamily != vm->vfamily)
+		return true;
+	if (vm->hfamily == AF_INET)
+		return vm->host.a4 != vm->virt.a4;
+	return !ipv6_addr_equal(&vm->host.a6, &vm->virt.a6);
+}
+
+static struct skip_vmap *skip_vmap_find(struct skip_sock *ssk,
+					struct sockaddr *sa)
+{
+	int n;
+	struct skip_vmap *vm;
+
+	for (n = 0; n < ssk->nvmaps; n++) {
+		vm = &ssk->vmaps[n];
+		if (sa->sa_family != vm->hfamily)
+			continue;
+		if (vm->hfamily == AF_INET ?
+		    ((struct sockaddr_in *)sa)->sin_addr.s_addr == vm->host.a4 :
+		    ipv6_addr_equal(&((struct sockaddr_in6 *)sa)->sin6_addr,
+				    &vm->host.a6))
+			return vm;
+	}
+
+	return NULL;
+}
+
+static int skip_vmap_translate(struct skip_sock *ssk, struct sockaddr *sa,
+			       int len)
+{
+	/* rewrite a host address of this socket in sa, a buffer of
+	 * sockaddr_storage, to its virtual address with the same
+	 * port. returns the new length. */
+
+	__be16 port;
+	struct skip_vmap *vm;
+	struct sockaddr_in *sin;
+	struct sockaddr_in6 *sin6;
+
+	vm = skip_vmap_find(ssk, sa);
+	if (!vm)
+		return len;
+
+	port = skip_sockaddr_port(sa);
+
+	if (vm->vfamily == AF_INET) {
+		sin = (struct sockaddr_in *)sa;
+		memset(sin, 0, sizeof(*sin));
+		sin->sin_family = AF_INET;
+		sin->sin_port = port;
+		sin->sin_addr.s_addr = vm->virt.a4;
+		return sizeof(*sin);
+	}
+
+	sin6 = (struct sockaddr_in6 *)sa;
+	memset(sin6, 0, sizeof(*sin6));
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = port;
+	sin6->sin6_addr = vm->virt.a6;
+	return sizeof(*sin6);
+}
+
+static inline void skip_map_4to6(const struct in6_addr *prefix,
+				 const struct sockaddr_in *sin,
+				 struct sockaddr_in6 *sin6)
+{
+	/* embed the IPv4 address in the low 32 bits of the prefix */
+	memset(sin6, 0, sizeof(*sin6));
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port = sin->sin_port;
+	sin6->sin6_addr = *prefix;
+	sin6->sin6_addr.s6_addr32[3] = sin->sin_addr.s_addr;
+}
+
+static inline bool skip_map_6to4(const struct in6_addr *prefix,
+				 const struct sockaddr_in6 *sin6,
+				 struct sockaddr_in *sin)
+{
+	/* addresses out of the prefix are not translated */
+	if (!ipv6_prefix_equal(&sin6->sin6_addr, prefix, 96))
+		return false;
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = sin6->sin6_port;
+	sin->sin_addr.s_addr = sin6->sin6_addr.s6_addr32[3];
+	return true;
+}
+
+static inline bool skip_map_v4(struct skip_sock *ssk, struct socket *hsock,
+			       struct sockaddr *sa, int len)
+{
+	/* IPv4 address to an IPv6 host socket of a mapped socket */
+	return ssk->map && hsock->sk->sk_family == AF_INET6 &&
+		sa->sa_family == AF_INET && len >= sizeof(struct sockaddr_in);
+}
+
+
+
+static void skip_sockopt_flush(struct skip_sock *ssk)
+{
+	struct skip_sockopt *opt, *tmp;
+
+	list_for_each_entry_safe(opt, tmp, &ssk->sockopts, list) {
+		list_del(&opt->list);
+		kfree(opt);
+	}
+}
+
+static int skip_sockopt_save(struct skip_sock *ssk, int level, int optname,
+			     char __user *optval, unsigned int optlen)
+{
+	struct skip_sockopt *opt;
+
+	/* options carrying user pointers can not be replayed by
+	 * kernel_setsockopt() */
+	if (level == SOL_SOCKET &&
+	    (optname == SO_ATTACH_FILTER ||
+	     optname == SO_ATTACH_REUSEPORT_CBPF)) {
+		pr_debug("%s: option %d must be set after bind/connect\n",
+			 __func__, optname);
+		return -EINVAL;
+	}
+
+	if (optlen > SKIP_SOCKOPT_MAXLEN)
+		return -EINVAL;
+
+	opt = kmalloc(sizeof(*opt) + optlen, GFP_KERNEL);
+	if (!opt)
+		return -ENOMEM;
+
+	if (copy_from_user(opt->optval, optval, optlen)) {
+		kfree(opt);
+		return -EFAULT;
+	}
+
+	opt->level = level;
+	opt->optname = optname;
+	opt->optlen = optlen;
+	list_add_tail(&opt->list, &ssk->sockopts);
+
+	return 0;
+}
+
+static struct socket *skip_hsock_alloc(struct skip_sock *ssk, int family)
+{
+	/* create a socket on host netns with the family of the host
+	 * address, and replay setsockopt()s called before. The host
+	 * netns is init_net unless the route bound through gives
+	 * another (ssk->hnet). called with ssk locked. */
+
+	int ret;
+	struct sock *sk = &ssk->sk;
+	struct net *hnet = ssk->hnet ? ssk->hnet : &init_net;
+	struct socket *hsock;
+	struct skip_sockopt *opt;
+
+	ret = __sock_create(hnet, family, sk->sk_type, sk->sk_protocol,
+			    &hsock, ssk->kern);
+	if (ret < 0) {
+		pr_err("%s: failed to create a socket on default netns\n",
+		       __func__);
+		return ERR_PTR(ret);
+	}
+
+	list_for_each_entry(opt, &ssk->sockopts, list) {
+		ret = kernel_setsockopt(hsock, opt->level, opt->optname,
+					opt->optval, opt->optlen);
+		if (ret)
+			pr_debug("%s: replay setsockopt %d:%d failed '%d'\n",
+				 __func__, opt->level, opt->optname, ret);
+	}
+
+	return hsock;
+}
+
+static void skip_hsock_share_wq(struct skip_sock *ssk, struct socket *hsock)
+{
+	/* Wake up the waiters of this socket by events on hsock.
+	 * Every host socket of a skip socket shares the wait queue
+	 * of it from when it is attached until it is released, and
+	 * poll(), epoll and the blocking calls of hsock all sleep
+	 * there. An event on hsock is a single wake_up() on a single
+	 * queue, so EPOLLEXCLUSIVE and EPOLLET work as on native
+	 * sockets, and waiters queued before hsock is created (e.g.,
+	 * epoll_ctl() before connect()) are not missed. The fasync
+	 * list is of the queue too, see skip_hsock_sync_fasync(). */
+
+	struct sock *hsk = hsock->sk;
+
+	write_lock_bh(&hsk->sk_callback_lock);
+	hsk->sk_wq = ssk->sock->wq;
+	write_unlock_bh(&hsk->sk_callback_lock);
+	sock_valbool_flag(hsk, SOCK_FASYNC, sock_flag(&ssk->sk, SOCK_FASYNC));
+}
+
+static void skip_hsock_sync_fasync(struct skip_sock *ssk)
+{
+	/* sock_fasync() sets SOCK_FASYNC of this socket only, while
+	 * sk_wake_async() of hsock checks the flag of hsock before
+	 * signaling the fasync list of the shared queue. Mirror the
+	 * flag on the host sockets. called with ssk owned. */
+
+	int n;
+	bool on = sock_flag(&ssk->sk, SOCK_FASYNC);
+	struct socket *hsock;
+
+	for (n = 0; n <= ssk->nfanin; n++) {
+		hsock = skip_hsock_n(ssk, n);
+		if (hsock && sock_flag(hsock->sk, SOCK_FASYNC) != on)
+			sock_valbool_flag(hsock->sk, SOCK_FASYNC, on);
+	}
+}
+
+static void skip_hsock_unshare_wq(struct socket *hsock)
+{
+	/* before hsock is released */
+
+	struct sock *hsk = hsock->sk;
+
+	write_lock_bh(&hsk->sk_callback_lock);
+	hsk->sk_wq = hsock->wq;
+	write_unlock_bh(&hsk->sk_callback_lock);
+}
+
+static int skip_hsock_create(struct skip_sock *ssk, int family)
+{
+	/* create the host socket of this socket. called with ssk
+	 * locked. */
+
+	struct sock *sk = &ssk->sk;
+	struct socket *hsock = NULL;
+
+	if (ssk->hsock)
+		return 0;
+
+	/* a host socket of the user on the default netns without
+	 * sockopts to replay is recycled on close, see skip_pool.c */
+	ssk->recyclable = (skip_pool_active() && !ssk->kern && !ssk->hnet &&
+			   list_empty(&ssk->sockopts));
+	if (ssk->recyclable)
+		hsock = skip_pool_get(family, sk->sk_type, sk->sk_protocol);
+	if (!hsock)
+		hsock = skip_hsock_alloc(ssk, family);
+	if (IS_ERR(hsock))
+		return PTR_ERR(hsock);
+	if (ssk->recyclable)
+		ssk->hcred = get_current_cred();
+
+	skip_sockopt_flush(ssk);
+
+	skip_hsock_share_wq(ssk, hsock);
+	smp_store_release(&ssk->hsock, hsock);
+
+	return 0;
+}
+
+static void skip_hsock_set_net(struct skip_sock *ssk, struct net *net)
+{
+	/* netns to create hsock in, taking the reference of net.
+	 * init_net is kept as NULL. called with ssk locked before
+	 * hsock is created. */
+
+	if (ssk->hnet)
+		put_net(ssk->hnet);
+	ssk->hnet = NULL;
+
+	if (net_eq(net, &init_net))
+		put_net(net);
+	else
+		ssk->hnet = net;
+}
+
+static int skip_hsock_family(struct skip_sock *ssk, int family)
+{
+	/* host family for a socket not bound through any route
+	 * (connect() and sendmsg() without bind()). IPv4 goes to an
+	 * IPv6 host socket if the netns has a v4v6map route. called
+	 * with ssk locked. */
+
+	if (family == AF_INET && !ssk->hsock &&
+	    skip_lwt_map_prefix(sock_net(&ssk->sk), &ssk->map_prefix)) {
+		ssk->map = true;
+		return AF_INET6;
+	}
+
+	return family;
+}
+
+static u32 skip_flow_hash(struct skip_sock *ssk, struct sockaddr *daddr)
+{
+	/* spreads the connections of a socket to the same
+	 * destination too, the socket is a part of the flow */
+
+	u32 seed = hash_ptr(ssk, 32);
+	struct sockaddr_in *sin = (struct sockaddr_in *)daddr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)daddr;
+
+	if (daddr->sa_family == AF_INET)
+		return jhash_2words((__force u32)sin->sin_addr.s_addr,
+				    (__force u32)sin->sin_port, seed);
+
+	return jhash_2words(ipv6_addr_hash(&sin6->sin6_addr),
+			    (__force u32)sin6->sin6_port, seed);
+}
+
+static int skip_srcs_bind(struct skip_sock *ssk, struct socket *hsock,
+			  struct sockaddr *daddr)
+{
+	/* A socket bound with port 0 through a route with a source
+	 * address pool is bound to the first address without port
+	 * (IP_BIND_ADDRESS_NO_PORT) at bind(). Rebind it to the
+	 * address picked by the flow hash before connect(), which
+	 * chooses the port. called with ssk locked. */
+
+	int ret, n;
+	struct skip_addr_list *srcs = ssk->srcs;
+	struct sockaddr_storage saddr_s;
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)&saddr_s;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)&saddr_s;
+
+	/* the port is taken already, by listen() or a connect() */
+	if (!srcs || inet_sk(hsock->sk)->inet_num)
+		return 0;
+
+	if (daddr->sa_family != hsock->sk->sk_family)
+		return 0;	/* let connect() fail */
+
+	n = skip_flow_hash(ssk, daddr) % srcs->count;
+	if (n == 0)
+		return 0;	/* bound to the first one at bind() */
+
+	memset(&saddr_s, 0, sizeof(saddr_s));
+	if (srcs->family == AF_INET) {
+		sa4->sin_family = AF_INET;
+		sa4->sin_addr.s_addr = srcs->addr[n].a4;
+	} else {
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_addr = srcs->addr[n].a6;
+	}
+
+	ret = hsock->ops->bind(hsock, (struct sockaddr *)&saddr_s,
+			       skip_sockaddr_len((struct sockaddr *)&saddr_s));
+	if (ret) {
+		pr_debug("%s: bind to pool address %d failed '%d'\n",
+			 __func__, n, ret);
+		return ret;
+	}
+
+	ssk->vmaps = &ssk->vmap;
+	ssk->nvmaps = skip_vmap_set(&ssk->vmap, (struct sockaddr *)&saddr_s,
+				    (struct sockaddr *)&ssk->vaddr) ? 1 : 0;
+
+	return 0;
+}
+
+static void skip_hsock_data_ready(struct sock *hsk)
+{
+	/* relay: data arrived at hsock, tell the in-kernel reader
+	 * attached to the skip socket. The skip socket is found by
+	 * the inode of hsock, as sk_user_data of hsk is left to the
+	 * users of it. Called with BH disabled, see skip_read_sock(). */
+
+	struct socket *hsock;
+	struct skip_sock *ssk = NULL;
+
+	read_lock_bh(&hsk->sk_callback_lock);
+	hsock = hsk->sk_socket;
+	if (hsock)
+		ssk = SOCK_INODE(hsock)->i_private;
+	if (ssk) {
+		ssk->hsk_data_ready(hsk);
+		/* the default one would wake up the shared wait
+		 * queue again */
+		if (ssk->sk.sk_data_ready != ssk->def_data_ready)
+			ssk->sk.sk_data_ready(&ssk->sk);
+	}
+	read_unlock_bh(&hsk->sk_callback_lock);
+}
+
+static void skip_hsock_relay(struct skip_sock *ssk)
+{
+	/* strparser (KCM) and alike replace sk_data_ready() of the
+	 * skip socket and read it by ->read_sock(), while the data
+	 * arrives at hsock. Relay the event, installed on the first
+	 * read so that other sockets do not pay for it. */
+
+	struct sock *hsk = ssk->hsock->sk;
+
+	if (likely(READ_ONCE(ssk->hsk_data_ready)))
+		return;
+
+	write_lock_bh(&hsk->sk_callback_lock);
+	if (!ssk->hsk_data_ready) {
+		SOCK_INODE(ssk->hsock)->i_private = ssk;
+		ssk->hsk_data_ready = hsk->sk_data_ready;
+		hsk->sk_data_ready = skip_hsock_data_ready;
+		ssk->recyclable = false;
+	}
+	write_unlock_bh(&hsk->sk_callback_lock);
+}
+
+static void skip_hsock_unrelay(struct skip_sock *ssk)
+{
+	/* restore sk_data_ready() unless another user stacked on top
+	 * of the relay. then the relay stays and finds no socket. */
+
+	struct sock *hsk = ssk->hsock->sk;
+
+	if (!ssk->hsk_data_ready)
+		return;
+
+	write_lock_bh(&hsk->sk_callback_lock);
+	if (hsk->sk_data_ready == skip_hsock_data_ready)
+		hsk->sk_data_ready = ssk->hsk_data_ready;
+	SOCK_INODE(ssk->hsock)->i_private = NULL;
+	write_unlock_bh(&hsk->sk_callback_lock);
+}
+
+static unsigned int skip_fanin_poll(struct skip_sock *ssk)
+{
+	int n;
+	unsigned int mask = 0;
+	struct socket *hsock;
+
+	for (n = 0; n <= ssk->nfanin; n++) {
+		hsock = skip_hsock_n(ssk, n);
+		mask |= hsock->ops->poll(NULL, hsock, NULL);
+	}
+
+	return mask;
+}
+
+static int skip_fanin_wait(struct skip_sock *ssk, long *timeo)
+{
+	/* wait for any of host sockets of a wildcard bound socket
+	 * to be readable. they share the wait queue of this socket
+	 * (skip_hsock_share_wq()). */
+
+	int ret = 0;
+	struct sock *sk = &ssk->sk;
+	DEFINE_WAIT(wait);
+
+	if (!*timeo)
+		return -EAGAIN;
+
+	prepare_to_wait(sk_sleep(sk), &wait, TASK_INTERRUPTIBLE);
+	if (!(skip_fanin_poll(ssk) & (POLLIN | POLLRDNORM | POLLERR)))
+		*timeo = schedule_timeout(*timeo);
+	finish_wait(sk_sleep(sk), &wait);
+
+	if (signal_pending(current))
+		ret = sock_intr_errno(*timeo);
+	else if (!*timeo)
+		ret = -EAGAIN;
+
+	return ret;
+}
+
+static int skip_bind_any(struct socket *sock, struct sockaddr *uaddr,
+			 int addr_len)
+{
+	/* Wildcard bind: bind host sockets to all host addresses of
+	 * the inbound skip routes of this netns with the same port. The
+	 * first one is hsock, and the others are fanin[]. All of
+	 * them share the wait queue of this socket, so that poll(),
+	 * accept() and recvmsg() on this socket see all of them.
+	 * called with ssk locked. */
+
+	int ret, n, count, alen, nvmaps;
+	__be16 port;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct skip_host_addrs *ha;
+	struct sockaddr_storage *addrs, *vaddrs;
+	struct sockaddr *addr;
+	struct socket *hsocks[SKIP_FANIN_MAX];
+	struct skip_vmap *vmaps;
+
+	if (ssk->hsock)
+		return -EINVAL;
+
+	ha = kzalloc(sizeof(*ha), GFP_KERNEL);
+	if (!ha)
+		return -ENOMEM;
+	addrs = ha->addrs;
+	vaddrs = ha->vaddrs;
+
+	vmaps = kcalloc(SKIP_FANIN_MAX, sizeof(*vmaps), GFP_KERNEL);
+	if (!vmaps) {
+		kfree(ha);
+		return -ENOMEM;
+	}
+
+	count = skip_lwt_host_addrs(sock_net(sock->sk), uaddr->sa_family,
+				    ha);
+	if (count <= 0) {
+		pr_debug("%s: no skip route found\n", __func__);
+		if (ha->net)
+			put_net(ha->net);
+		ret = count ? count : -ENONET;
+		goto free_out;
+	}
+	skip_hsock_set_net(ssk, ha->net);
+
+	port = skip_sockaddr_port(uaddr);
+
+	for (n = 0; n < count; n++) {
+		addr = (struct sockaddr *)&addrs[n];
+		hsocks[n] = skip_hsock_alloc(ssk, addr->sa_family);
+		if (IS_ERR(hsocks[n])) {
+			ret = PTR_ERR(hsocks[n]);
+			goto release_out;
+		}
+
+		skip_sockaddr_set_port(addr, port);
+		alen = skip_sockaddr_len(addr);
+		ret = hsocks[n]->ops->bind(hsocks[n], addr, alen);
+		if (ret) {
+			pr_debug("%s: bind to host address %d failed '%d'\n",
+				 __func__, n, ret);
+			n++;
+			goto release_out;
+		}
+
+		if (!port) {
+			/* others use the port chosen for the first one */
+			ret = kernel_getsockname(hsocks[n], addr, &alen);
+			if (ret) {
+				n++;
+				goto release_out;
+			}
+			port = skip_sockaddr_port(addr);
+		}
+	}
+
+	for (n = 0; n < count; n++) {
+		skip_hsock_share_wq(ssk, hsocks[n]);
+		if (n)
+			ssk->fanin[n - 1] = hsocks[n];
+	}
+	ssk->nfanin = count - 1;
+	ssk->any = true;
+	ssk->policy = ha->policy;
+
+	/* IPv4 wildcard over IPv6 host addresses of v4v6map routes */
+	if (uaddr->sa_family == AF_INET)
+		ssk->map = skip_lwt_map_prefix(sock_net(sock->sk),
+					       &ssk->map_prefix);
+
+	/* host addresses of host routes have a single virtual
+	 * address, that accepted sockets see as the local address */
+	for (nvmaps = 0, n = 0; n < count && !ssk->map; n++) {
+		if (vaddrs[n].ss_family &&
+		    skip_vmap_set(&vmaps[nvmaps], (struct sockaddr *)&addrs[n],
+				  (struct sockaddr *)&vaddrs[n]))
+			nvmaps++;
+	}
+	if (nvmaps) {
+		ssk->vmaps = vmaps;
+		ssk->nvmaps = nvmaps;
+		vmaps = NULL;
+	}
+
+	memset(&ssk->vaddr, 0, sizeof(ssk->vaddr));
+	memcpy(&ssk->vaddr, uaddr, skip_sockaddr_len(uaddr));
+	skip_sockaddr_set_port((struct sockaddr *)&ssk->vaddr, port);
+
+	skip_sockopt_flush(ssk);
+	smp_store_release(&ssk->hsock, hsocks[0]);
+
+	pr_debug("%s: bound to %d host addresses\n", __func__, count);
+	ret = 0;
+	goto free_out;
+
+release_out:
+	while (n-- > 0)
+		sock_release(hsocks[n]);
+free_out:
+	kfree(vmaps);
+	kfree(ha);
+	return ret;
+}
+
+static void skip_stats_set(struct skip_sock *ssk, struct skip_stats *stats)
+{
+	/* replace the counters of this socket, taking the reference
+	 * of stats. sendmsg() and recvmsg() on other threads may
+	 * still count on the old ones under rcu_read_lock(), and
+	 * skip_stats_put() frees them after a grace period. called
+	 * with ssk locked. */
+
+	struct skip_stats *old;
+
+	old = rcu_dereference_protected(ssk->stats,
+					lockdep_sock_is_held(&ssk->sk));
+	rcu_assign_pointer(ssk->stats, stats);
+	skip_stats_put(old);
+}
+
+static bool skip_handoff_safe(struct socket *sock)
+{
+	/* The file of this socket is rewired to the host socket. It
+	 * is safe only if no one else can be in a system call on
+	 * this socket: the file is not shared by other fds or
+	 * processes, and the fd table is not shared by other
+	 * threads (fdget() does not take a reference then).
+	 * poll() and epoll waiters need no care, they sleep on the
+	 * wait queue of this socket that the grafted sock keeps
+	 * using. */
+
+	if (!sock->file || file_count(sock->file) != 1)
+		return false;
+
+	if (atomic_read(&current->files->count) != 1)
+		return false;
+
+	return true;
+}
+
+static void skip_handoff(struct socket *sock)
+{
+	/* Hand the host socket over to the user: graft the sock of
+	 * hsock to this socket and switch the ops to the host
+	 * family ops. The skip sock and the struct socket of hsock
+	 * are released, so that the following system calls on the
+	 * fd go to the native TCP/UDP path directly. */
+
+	struct sock *sk = sock->sk;
+	struct skip_sock *ssk = skip_sk(sk);
+	struct socket *hsock = ssk->hsock;
+	struct sock *hsk = hsock->sk;
+
+	if (!skip_handoff_safe(sock)) {
+		pr_debug("%s: socket is shared, handoff skipped\n", __func__);
+		return;
+	}
+
+	skip_diag_unlink(sk);
+
+	/* skip_sock_reset() may have taken sk before the unlink */
+	lock_sock(sk);
+
+	sock_graft(hsk, sock);
+	sock->state = hsock->state;
+	sock->ops = hsock->ops;
+
+	/* the module reference of hsock->ops moves to this socket
+	 * with the ops. release hsock without ops->release(). */
+	hsock->sk = NULL;
+	hsock->ops = NULL;
+	sock_release(hsock);
+	ssk->hsock = NULL;
+
+	/* handed off sockets are not counted anymore */
+	skip_stats_set(ssk, NULL);
+	skip_addr_list_put(ssk->srcs);
+	ssk->srcs = NULL;
+	if (ssk->hnet)
+		put_net(ssk->hnet);
+	ssk->hnet = NULL;
+	if (ssk->hcred)
+		put_cred(ssk->hcred);
+	ssk->hcred = NULL;
+
+	sock_orphan(sk);
+	release_sock(sk);
+	sock_put(sk);
+
+	/* drop the reference for skip_proto_ops taken at socket() */
+	module_put(THIS_MODULE);
+
+	pr_debug("%s: handoff success\n", __func__);
+}
+
+static int skip_release(struct socket *sock)
+{
+	int n;
+	struct sock *sk = sock->sk;
+	struct skip_sock *ssk;
+
+	if (!sk) {
+		pr_debug("%s, NULL sk\n", __func__);
+		return 0;
+	}
+	pr_debug("%s\n", __func__);
+
+	skip_diag_unlink(sk);
+
+	/* skip_sock_reset() may have taken sk before the unlink. It
+	 * sees SOCK_DEAD after this. */
+	ssk = skip_sk(sk);
+	lock_sock(sk);
+	for (n = 0; n < ssk->nfanin; n++) {
+		skip_hsock_unshare_wq(ssk->fanin[n]);
+		sock_release(ssk->fanin[n]);
+		ssk->fanin[n] = NULL;
+	}
+	ssk->nfanin = 0;
+	if (ssk->hsock) {
+		skip_hsock_unshare_wq(ssk->hsock);
+		skip_hsock_unrelay(ssk);
+		if (!(ssk->recyclable &&
+		      skip_pool_put(ssk->hsock, ssk->hcred)))
+			sock_release(ssk->hsock);
+		ssk->hsock = NULL;
+	}
+	if (ssk->hcred)
+		put_cred(ssk->hcred);
+	ssk->hcred = NULL;
+	if (ssk->vsock)
+		sock_release(ssk->vsock);
+	ssk->vsock = NULL;
+	skip_sockopt_flush(ssk);
+	skip_stats_set(ssk, NULL);
+	skip_addr_list_put(ssk->srcs);
+	ssk->srcs = NULL;
+	if (ssk->hnet)
+		put_net(ssk->hnet);
+	ssk->hnet = NULL;
+	if (ssk->vmaps != &ssk->vmap)
+		kfree(ssk->vmaps);
+	ssk->vmaps = NULL;
+	ssk->nvmaps = 0;
+	kfree(ssk->dcache);
+	ssk->dcache = NULL;
+
+	sock_orphan(sk);
+	release_sock(sk);
+	sk_refcnt_debug_release(sk);
+	sock_put(sk);
+
+	sock->sk = NULL;
+
+	return 0;
+}
+
+static int skip_find_lwtstate(struct socket *sock, struct sockaddr *daddr,
+			      struct skip_lwt **slwtp)
+{
+	/* find skip lwtunnel state from the per-netns prefix table.
+	 * The caller must hold rcu_read_lock() while using *slwtp. */
+
+	struct skip_lwt *slwt;
+
+	switch (daddr->sa_family) {
+	case AF_INET:
+	case AF_INET6:
+		break;
+
+	default :
+		pr_err("%s: address family '%u' does not supported\n",
+		       __func__, daddr->sa_family);
+		return -EAFNOSUPPORT;
+	}
+
+	slwt = skip_lwt_lookup(sock_net(sock->sk), daddr);
+	if (!slwt) {
+		pr_debug("%s: no skip route found\n", __func__);
+		return -ENONET;
+	}
+
+	*slwtp = slwt;
+
+	return 0;
+}
+
+static bool skip_hsock_on_route(struct socket *hsock, struct skip_lwt *slwt)
+{
+	/* hsock is bound to the host address or a pool address of
+	 * slwt. called under rcu_read_lock(). */
+
+	int n;
+	struct sock *hsk = hsock->sk;
+	struct skip_host *sh = slwt->host;
+	struct skip_addr_list *list = sh->addr_list;
+
+	if (hsk->sk_family != sh->host_family ||
+	    !net_eq(sock_net(hsk), skip_lwt_host_net(slwt)))
+		return false;
+
+	if (hsk->sk_family == AF_INET) {
+		if (inet_sk(hsk)->inet_rcv_saddr == sh->host_addr4)
+			return true;
+		for (n = 0; list && n < list->count; n++)
+			if (inet_sk(hsk)->inet_rcv_saddr == list->addr[n].a4)
+				return true;
+	} else {
+		if (ipv6_addr_equal(&hsk->sk_v6_rcv_saddr, &sh->host_addr6))
+			return true;
+		for (n = 0; list && n < list->count; n++)
+			if (ipv6_addr_equal(&hsk->sk_v6_rcv_saddr,
+					    &list->addr[n].a6))
+				return true;
+	}
+
+	return false;
+}
+
+static void skip_revalidate(struct skip_sock *ssk)
+{
+	/* The skip routes of the netns changed since this socket
+	 * resolved the route of the address it is bound to. Take the
+	 * policy, counters and pool of the route of the address now.
+	 * A socket that has no port yet (IP_BIND_ADDRESS_NO_PORT) is
+	 * moved to the new host address of a replaced route. Others
+	 * whose host address is not of the route anymore are stale:
+	 * connect(), listen() and accept() fail while established
+	 * connections live on. called with ssk locked. */
+
+	int ret;
+	bool on_route = false, moved = false;
+	u8 policy = 0;
+	u32 gen = skip_lwt_gen(sock_net(&ssk->sk));
+	struct skip_lwt *slwt;
+	struct skip_stats *stats = NULL;
+	struct skip_addr_list *srcs = NULL;
+	struct socket *hsock = ssk->hsock;
+	struct sockaddr_storage saddr_s;
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)&saddr_s;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)&saddr_s;
+
+	if (ssk->stale || !hsock)
+		return;
+
+	rcu_read_lock();
+	slwt = skip_lwt_lookup(sock_net(&ssk->sk),
+			       (struct sockaddr *)&ssk->vaddr);
+	if (slwt) {
+		on_route = ssk->map || skip_hsock_on_route(hsock, slwt);
+		moved = !on_route && !inet_sk(hsock->sk)->inet_num &&
+			slwt->host->host_family == hsock->sk->sk_family &&
+			net_eq(sock_net(hsock->sk), skip_lwt_host_net(slwt));
+	}
+	if (on_route || moved) {
+		policy = slwt->host->policy;
+		stats = skip_lwt_stats_get(slwt);
+		if (ssk->srcs || moved)
+			srcs = skip_lwt_addr_list_get(slwt);
+		memset(&saddr_s, 0, sizeof(saddr_s));
+		if (slwt->host->host_family == AF_INET) {
+			sa4->sin_family = AF_INET;
+			sa4->sin_addr.s_addr = slwt->host->host_addr4;
+		} else {
+			sa6->sin6_family = AF_INET6;
+			sa6->sin6_addr = slwt->host->host_addr6;
+		}
+	}
+	rcu_read_unlock();
+
+	if (moved) {
+		ret = hsock->ops->bind(hsock, (struct sockaddr *)&saddr_s,
+				       skip_sockaddr_len((struct sockaddr *)
+							 &saddr_s));
+		if (ret) {
+			pr_debug("%s: rebind to new host address failed "
+				 "'%d'\n", __func__, ret);
+			skip_stats_put(stats);
+			skip_addr_list_put(srcs);
+			moved = false;
+		} else {
+			ssk->vmaps = &ssk->vmap;
+			ssk->nvmaps = skip_vmap_set(&ssk->vmap,
+						    (struct sockaddr *)&saddr_s,
+						    (struct sockaddr *)
+						    &ssk->vaddr) ? 1 : 0;
+		}
+	}
+
+	if (on_route || moved) {
+		ssk->policy = policy;
+		skip_stats_set(ssk, stats);
+		skip_addr_list_put(ssk->srcs);
+		ssk->srcs = srcs;
+	} else {
+		pr_debug("%s: route of the socket has gone\n", __func__);
+		WRITE_ONCE(ssk->stale, true);
+	}
+
+	ssk->gen = gen;
+}
+
+static int skip_permit(struct skip_sock *ssk, u8 policy)
+{
+	/* policy check of connect(), listen() and accept(). Sockets
+	 * bound through a route revalidate it when the routes of the
+	 * netns changed, otherwise this costs a compare. Wildcard
+	 * bound sockets have no single route to revalidate, and
+	 * listen on the host addresses of inbound routes at bind()
+	 * only (see skip_lwt_host_addrs()). */
+
+	if (rcu_access_pointer(ssk->stats) && !ssk->any &&
+	    unlikely(READ_ONCE(ssk->gen) != skip_lwt_gen(sock_net(&ssk->sk)))) {
+		lock_sock(&ssk->sk);
+		skip_revalidate(ssk);
+		release_sock(&ssk->sk);
+	}
+
+	if (READ_ONCE(ssk->stale))
+		return -ENONET;
+
+	if (ssk->policy & policy)
+		return 0;
+
+	if (policy & SKIP_POLICY_INBOUND)
+		skip_sk_stats_inc(ssk, reject_inbound);
+	else
+		skip_sk_stats_inc(ssk, reject_outbound);
+
+	return -EPERM;
+}
+
+void skip_sock_reset(struct sock *sk)
+{
+	/* a route sharing the counters of this socket is deleted
+	 * (see reset_stale of skip_lwt.c). If it was the route of
+	 * this socket, abort the host sockets as SOCK_DESTROY does. */
+
+	int n;
+	struct skip_sock *ssk = skip_sk(sk);
+	struct socket *hsock;
+
+	lock_sock(sk);
+	if (sock_flag(sk, SOCK_DEAD)) {
+		/* closed or handed off, see skip_release() */
+		release_sock(sk);
+		return;
+	}
+	skip_revalidate(ssk);
+	for (n = 0; ssk->stale && ssk->hsock && n <= ssk->nfanin; n++) {
+		hsock = skip_hsock_n(ssk, n);
+		if (hsock->sk && hsock->sk->sk_prot->diag_destroy)
+			hsock->sk->sk_prot->diag_destroy(hsock->sk,
+							 ECONNABORTED);
+	}
+	release_sock(sk);
+}
+
+static int skip_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
+{
+	int ret, h_addrlen, one = 1;
+	bool handoff, map = false;
+	u8 policy;
+	struct in6_addr map_prefix;
+	struct skip_lwt *slwt;
+	struct skip_stats *stats;
+	struct skip_addr_list *srcs = NULL;
+	struct net *hnet;
+	u32 gen;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock;
+	struct sockaddr_storage saddr_s;
+	struct sockaddr_in *sa4;
+	struct sockaddr_in6 *sa6;
+	//struct socket *vsock = skip_vsock(skip_sk(sock->sk));
+
+	/* XXX:
+	 *
+	 * 1. Search routing table and find lwtunnel skip state.
+	 * 2. translate uaddr and addr_len and call bind() for hsock.
+	 * Then, call bind() to the socket on host netns.
+	 *
+	 * Consider carefully. 
+	 * - bind() for virtual socket too?
+	 */
+
+	if (!uaddr || addr_len < sizeof(uaddr->sa_family))
+		return -EINVAL;
+
+	if ((uaddr->sa_family == AF_INET &&
+	     addr_len < sizeof(struct sockaddr_in)) ||
+	    (uaddr->sa_family == AF_INET6 &&
+	     addr_len < SIN6_LEN_RFC2133))
+		return -EINVAL;
+
+	lock_sock(sock->sk);
+
+	if (skip_sockaddr_any(uaddr)) {
+		/* INADDR_ANY and in6addr_any */
+		ret = skip_bind_any(sock, uaddr, addr_len);
+		if (!ret)
+			ssk->bound = true;
+		release_sock(sock->sk);
+		return ret;
+	}
+
+	gen = skip_lwt_gen(sock_net(sock->sk));
+	rcu_read_lock();
+	ret = skip_find_lwtstate(sock, uaddr, &slwt);
+	if (ret) {
+		rcu_read_unlock();
+		pr_debug("%s: no skip route found\n", __func__);
+		goto out;
+	}
+	handoff = slwt->host->handoff;
+	policy = slwt->host->policy;
+	stats = skip_lwt_stats_get(slwt);
+
+	memset(&saddr_s, 0, sizeof(saddr_s));
+	switch (slwt->host->host_family) {
+	case AF_INET:
+		sa4 = (struct sockaddr_in *)&saddr_s;
+		sa4->sin_family = AF_INET;
+		sa4->sin_addr.s_addr = slwt->host->host_addr4;
+		sa4->sin_port = ((struct sockaddr_in *)uaddr)->sin_port;
+		h_addrlen = sizeof(struct sockaddr_in);
+		break;
+
+	case AF_INET6:
+		sa6 = (struct sockaddr_in6 *)&saddr_s;
+		if (slwt->host->v4v6map && uaddr->sa_family == AF_INET) {
+			map = true;
+			map_prefix = slwt->host->map_prefix;
+			skip_map_4to6(&map_prefix, (struct sockaddr_in *)uaddr,
+				      sa6);
+			/* the mapped address unless host address given */
+			if (!ipv6_addr_any(&slwt->host->host_addr6))
+				sa6->sin6_addr = slwt->host->host_addr6;
+		} else {
+			sa6->sin6_family = AF_INET6;
+			sa6->sin6_addr = slwt->host->host_addr6;
+			sa6->sin6_port =
+				((struct sockaddr_in6 *)uaddr)->sin6_port;
+		}
+		h_addrlen = sizeof(struct sockaddr_in6);
+		break;
+
+	default :
+		pr_debug("%s: invalid family '%u' of skip route\n",
+			 __func__, slwt->host->host_family);
+		rcu_read_unlock();
+		ret = -EAFNOSUPPORT;
+		goto fail_out;
+	}
+	/* source pool for connect() after bind() with port 0 */
+	if (!map && !skip_sockaddr_port(uaddr))
+		srcs = skip_lwt_addr_list_get(slwt);
+	hnet = maybe_get_net(skip_lwt_host_net(slwt));
+	rcu_read_unlock();
+
+	if (!hnet) {
+		ret = -ENONET;	/* the route is going away */
+		goto fail_out;
+	}
+
+	if (!ssk->hsock)
+		skip_hsock_set_net(ssk, hnet);
+	else {
+		/* e.g., created by sendmsg() before */
+		ret = net_eq(hnet, sock_net(ssk->hsock->sk)) ? 0 : -EINVAL;
+		put_net(hnet);
+		if (ret)
+			goto fail_out;
+	}
+
+	ret = skip_hsock_create(ssk, saddr_s.ss_family);
+	if (ret)
+		goto fail_out;
+
+	hsock = skip_hsock(ssk);
+	if (srcs) {
+		ret = kernel_setsockopt(hsock, SOL_IP, IP_BIND_ADDRESS_NO_PORT,
+					(char *)&one, sizeof(one));
+		if (ret)
+			goto fail_out;
+	}
+	ret = hsock->ops->bind(hsock, (struct sockaddr *)&saddr_s, h_addrlen);
+	if (ret) {
+		pr_debug("%s: hsock->ops->bind() failed, ret=%d\n",
+			 __func__, ret);
+		goto fail_out;
+	}
+
+	pr_debug("%s: bind success\n", __func__);
+	ssk->bound = true;	/* this socket is already bind()ed */
+	ssk->handoff = handoff && !map;	/* IPv6 socket to IPv4 user */
+	/* a handed off socket is native and can not be restricted */
+	if (policy != SKIP_POLICY_ANY)
+		ssk->handoff = false;
+	ssk->policy = policy;
+	ssk->gen = gen;
+	ssk->stale = false;
+	ssk->map = map;
+	if (map)
+		ssk->map_prefix = map_prefix;
+	memset(&ssk->vaddr, 0, sizeof(ssk->vaddr));
+	memcpy(&ssk->vaddr, uaddr, skip_sockaddr_len(uaddr));
+	if (!map && skip_vmap_set(&ssk->vmap, (struct sockaddr *)&saddr_s,
+				  uaddr)) {
+		ssk->vmaps = &ssk->vmap;
+		ssk->nvmaps = 1;
+	}
+
+	skip_stats_inc(stats, bind);
+	skip_stats_set(ssk, stats);
+	skip_addr_list_put(ssk->srcs);
+	ssk->srcs = srcs;
+	goto out;
+
+fail_out:
+	skip_stats_inc(stats, lookup_fail);
+	skip_stats_put(stats);
+	skip_addr_list_put(srcs);
+out:
+	release_sock(sock->sk);
+
+	/* a socket with a source pool is handed off at connect() */
+	if (!ret && ssk->handoff && !ssk->srcs)
+		skip_handoff(sock);
+
+	return ret;
+}
+
+static int skip_route_saddr(struct net *net, struct sockaddr *daddr,
+			    struct sockaddr_storage *saddr)
+{
+	/* the source address the netns would choose toward daddr */
+
+	int ret;
+	struct rtable *rt;
+	struct dst_entry *dst;
+	struct flowi4 fl4;
+	struct flowi6 fl6;
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)saddr;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)saddr;
+
+	memset(saddr, 0, sizeof(*saddr));
+
+	switch (daddr->sa_family) {
+	case AF_INET:
+		memset(&fl4, 0, sizeof(fl4));
+		fl4.daddr = ((struct sockaddr_in *)daddr)->sin_addr.s_addr;
+		rt = ip_route_output_key(net, &fl4);
+		if (IS_ERR(rt))
+			return PTR_ERR(rt);
+		ip_rt_put(rt);
+		sa4->sin_family = AF_INET;
+		sa4->sin_addr.s_addr = fl4.saddr;
+		break;
 
-	struct socket *vsock;	/* socket with original family at namespace */
-	struct socket *hsock;	/* socket with original family at host */
-};
+	case AF_INET6:
+		memset(&fl6, 0, sizeof(fl6));
+		fl6.daddr = ((struct sockaddr_in6 *)daddr)->sin6_addr;
+		ret = ip6_dst_lookup(net, NULL, &dst, &fl6);
+		if (ret)
+			return ret;
+		dst_release(dst);
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_addr = fl6.saddr;
+		break;
+
+	default:
+		return -EAFNOSUPPORT;
+	}
+
+	return 0;
+}
+
+static int skip_connect_bind(struct skip_sock *ssk, int family,
+			     struct sockaddr *daddr)
+{
+	/* Lazy port binding of a socket not bound before connect(),
+	 * or before the first sendmsg() of a datagram socket: bind
+	 * the host socket to the host address of the skip route of
+	 * the source address that the netns chooses toward daddr,
+	 * without port (IP_BIND_ADDRESS_NO_PORT). The host connect()
+	 * (or autobind of sendmsg()) chooses the port. hsock is
+	 * created in the host netns of the route if not yet. -ENONET
+	 * if the source is not on a skip route. called with ssk
+	 * locked. */
+
+	int ret, one = 1;
+	u8 policy;
+	u32 gen;
+	struct net *hnet;
+	struct socket *hsock = ssk->hsock;
+	struct skip_lwt *slwt;
+	struct skip_stats *stats;
+	struct skip_addr_list *srcs;
+	struct sockaddr_storage vsrc_s, saddr_s;
+	struct sockaddr *vsrc = (struct sockaddr *)&vsrc_s;
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)&saddr_s;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)&saddr_s;
+
+	if (ssk->bound || (hsock && inet_sk(hsock->sk)->inet_num))
+		return 0;
+
+	gen = skip_lwt_gen(sock_net(&ssk->sk));
+	ret = skip_route_saddr(sock_net(&ssk->sk), daddr, &vsrc_s);
+	if (ret)
+		return -ENONET;
+
+	rcu_read_lock();
+	slwt = skip_lwt_lookup(sock_net(&ssk->sk), vsrc);
+	if (!slwt || slwt->host->v4v6map || slwt->host->host_family != family) {
+		rcu_read_unlock();
+		return -ENONET;
+	}
+
+	policy = slwt->host->policy;
+	stats = skip_lwt_stats_get(slwt);
+	if (!(policy & SKIP_POLICY_OUTBOUND)) {
+		rcu_read_unlock();
+		skip_stats_inc(stats, reject_outbound);
+		skip_stats_put(stats);
+		return -EPERM;
+	}
+
+	memset(&saddr_s, 0, sizeof(saddr_s));
+	if (slwt->host->host_family == AF_INET) {
+		sa4->sin_family = AF_INET;
+		sa4->sin_addr.s_addr = slwt->host->host_addr4;
+	} else {
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_addr = slwt->host->host_addr6;
+	}
+	srcs = skip_lwt_addr_list_get(slwt);
+	hnet = maybe_get_net(skip_lwt_host_net(slwt));
+	rcu_read_unlock();
+
+	if (!hnet) {
+		ret = -ENONET;
+	} else if (hsock) {
+		/* created by sendmsg() before, in the default netns */
+		ret = net_eq(hnet, sock_net(hsock->sk)) ? 0 : -ENONET;
+		put_net(hnet);
+	} else {
+		skip_hsock_set_net(ssk, hnet);
+		ret = skip_hsock_create(ssk, family);
+		hsock = ssk->hsock;
+	}
+	if (ret) {
+		skip_stats_put(stats);
+		skip_addr_list_put(srcs);
+		return ret;
+	}
+
+	ret = kernel_setsockopt(hsock, SOL_IP, IP_BIND_ADDRESS_NO_PORT,
+				(char *)&one, sizeof(one));
+	if (!ret)
+		ret = hsock->ops->bind(hsock, (struct sockaddr *)&saddr_s,
+				       skip_sockaddr_len((struct sockaddr *)
+							 &saddr_s));
+	if (ret) {
+		pr_debug("%s: bind to host address failed '%d'\n",
+			 __func__, ret);
+		skip_stats_inc(stats, lookup_fail);
+		skip_stats_put(stats);
+		skip_addr_list_put(srcs);
+		return ret;
+	}
+
+	/* bound implicitly, as the kernel autobinds */
+	ssk->bound = true;
+	ssk->autobind = true;
+	ssk->policy = policy;
+	ssk->gen = gen;
+	skip_stats_set(ssk, stats);
+	skip_addr_list_put(ssk->srcs);
+	ssk->srcs = srcs;
+	ssk->vaddr = vsrc_s;
+	ssk->vmaps = &ssk->vmap;
+	ssk->nvmaps = skip_vmap_set(&ssk->vmap, (struct sockaddr *)&saddr_s,
+				    vsrc) ? 1 : 0;
+
+	return 0;
+}
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static inline void skip_mark_napi_id(struct sock *sk, struct sock *hsk)
+{
+	/* busy poll of sock_poll() (poll() and select(), epoll does
+	 * not busy poll on 4.10) looks at this sock, not at the host
+	 * sock that received from the NAPI. taken from the host sock
+	 * at connect() and accept(), and by poll() and recvmsg().
+	 * XXX: a host sock that has not received by then (e.g.,
+	 * non-blocking connect()) is found by the first poll() or
+	 * recvmsg() only. */
+
+	unsigned int napi_id = READ_ONCE(hsk->sk_napi_id);
+
+	if (napi_id && READ_ONCE(sk->sk_napi_id) != napi_id)
+		WRITE_ONCE(sk->sk_napi_id, napi_id);
+}
+
+static void skip_busy_poll_sync(struct sock *sk, struct sock *hsk)
+{
+	/* SO_BUSY_POLL set on the host sock */
+
+	WRITE_ONCE(sk->sk_ll_usec, READ_ONCE(hsk->sk_ll_usec));
+}
+#else
+static inline void skip_mark_napi_id(struct sock *sk, struct sock *hsk)
+{
+}
+
+static inline void skip_busy_poll_sync(struct sock *sk, struct sock *hsk)
+{
+}
+#endif
+
+static int skip_connect(struct socket *sock, struct sockaddr *vaddr,
+			int sockaddr_len, int flags)
+{
+	int ret, family;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock;
+	struct sockaddr_in6 sin6;
+
+	/* XXX: bind() should be called for vsock? */
+
+	if (sockaddr_len < sizeof(vaddr->sa_family))
+		return -EINVAL;
+
+	ret = skip_permit(ssk, SKIP_POLICY_OUTBOUND);
+	if (ret)
+		return ret;
+
+	lock_sock(sock->sk);
+	family = skip_hsock_family(ssk, vaddr->sa_family);
+	ret = 0;
+	if (!ssk->bound && !ssk->map)
+		ret = skip_connect_bind(ssk, family, vaddr);
+	if (!ret)
+		ret = skip_hsock_create(ssk, family);
+	release_sock(sock->sk);
+	if (ret)
+		return ret;
+
+	hsock = skip_hsock(ssk);
+
+	if (skip_map_v4(ssk, hsock, vaddr, sockaddr_len)) {
+		skip_map_4to6(&ssk->map_prefix, (struct sockaddr_in *)vaddr,
+			      &sin6);
+		vaddr = (struct sockaddr *)&sin6;
+		sockaddr_len = sizeof(sin6);
+	}
+
+	if (ssk->srcs) {
+		lock_sock(sock->sk);
+		ret = skip_srcs_bind(ssk, hsock, vaddr);
+		release_sock(sock->sk);
+		if (ret)
+			return ret;
+	}
+
+	ret = hsock->ops->connect(hsock, vaddr, sockaddr_len, flags);
+	if (!ret || ret == -EINPROGRESS)
+		skip_sk_stats_inc(ssk, connect);
+	if (!ret)
+		skip_mark_napi_id(sock->sk, hsock->sk);
+
+	/* a socket bound through a handoff route that is not
+	 * handed off at bind() (e.g., bound but shared at that time)
+	 * can be handed off here */
+	if ((!ret || ret == -EINPROGRESS) && ssk->handoff)
+		skip_handoff(sock);
+
+	return ret;
+}
+
+static int skip_socketpair(struct socket *sock1, struct socket *sock2)
+{
+	/* XXX: ??? */
+
+	struct socket *hsock = skip_hsock(skip_sk(sock1->sk));
+
+	if (!hsock)
+		return -EOPNOTSUPP;
+	return hsock->ops->socketpair(hsock, sock2);
+}
+
+static int skip_accept_fanin(struct socket *sock, struct socket *newsocket,
+			     int flags, struct socket **hsockp)
+{
+	/* accept() on any of listening host sockets of a wildcard
+	 * bound socket. */
+
+	int ret, i, n;
+	unsigned int start;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock;
+	long timeo = sock_rcvtimeo(ssk->hsock->sk, flags & O_NONBLOCK);
+
+	n = ssk->nfanin + 1;
+
+	for (;;) {
+		start = READ_ONCE(ssk->fanin_next);
+		for (i = 0; i < n; i++) {
+			hsock = skip_hsock_n(ssk, (start + i) % n);
+			ret = hsock->ops->accept(hsock, newsocket,
+						 flags | O_NONBLOCK);
+			if (ret != -EAGAIN) {
+				WRITE_ONCE(ssk->fanin_next,
+					   (start + i + 1) % n);
+				*hsockp = hsock;
+				return ret;
+			}
+		}
+
+		ret = skip_fanin_wait(ssk, &timeo);
+		if (ret)
+			return ret;
+	}
+}
+
+static struct sock *skip_sk_alloc(struct net *net, struct socket *sock,
+				  int protocol, int kern);
+
+static int skip_accept_wrap(struct socket *sock, struct socket *newsocket,
+			    int flags)
+{
+	/* A child of a listener that translates addresses (mapped,
+	 * or with accept_vaddr, bound to a virtual address other
+	 * than the host one) is accepted to a host socket of its
+	 * own, and newsocket stays a skip socket over it, so that
+	 * getname() and recvmsg() on the child are translated as
+	 * well. It costs a skip sock per connection. */
+
+	int ret, len;
+	struct skip_sock *ssk = skip_sk(sock->sk), *nssk;
+	struct socket *hsock = skip_hsock(ssk), *hnew;
+	struct sockaddr_storage name;
+	struct skip_vmap *vm;
+	struct sock *nsk;
+
+	ret = sock_create_lite(hsock->sk->sk_family, hsock->type,
+			       hsock->sk->sk_protocol, &hnew);
+	if (ret)
+		return ret;
+
+	if (ssk->nfanin)
+		ret = skip_accept_fanin(sock, hnew, flags, &hsock);
+	else
+		ret = hsock->ops->accept(hsock, hnew, flags);
+	if (ret)
+		goto release_out;
+
+	hnew->ops = hsock->ops;
+	__module_get(hnew->ops->owner);
+
+	nsk = skip_sk_alloc(sock_net(sock->sk), newsocket,
+			    sock->sk->sk_protocol, ssk->kern);
+	if (!nsk) {
+		ret = -ENOMEM;
+		goto release_out;
+	}
+
+	nssk = skip_sk(nsk);
+	nssk->bound = true;
+	nssk->policy = ssk->policy;
+	RCU_INIT_POINTER(nssk->stats, skip_sk_stats_get(ssk));
+	nssk->hnet = ssk->hnet ? get_net(ssk->hnet) : NULL;
+	nssk->map = ssk->map;
+	nssk->map_prefix = ssk->map_prefix;
+	nssk->vaddr = ssk->vaddr;
+	nssk->hsock = hnew;
+	skip_hsock_share_wq(nssk, hnew);
+	newsocket->state = SS_CONNECTED;
+	skip_busy_poll_sync(nsk, hnew->sk);
+	skip_mark_napi_id(nsk, hnew->sk);
+
+	/* the mapping of the local address of the child, one of
+	 * those of a wildcard listener */
+	if (ssk->nvmaps &&
+	    !hnew->ops->getname(hnew, (struct sockaddr *)&name, &len, 0)) {
+		vm = skip_vmap_find(ssk, (struct sockaddr *)&name);
+		if (vm) {
+			nssk->vmap = *vm;
+			nssk->vmaps = &nssk->vmap;
+			nssk->nvmaps = 1;
+		}
+	}
+
+	skip_sk_stats_inc(ssk, accept);
+
+	return 0;
+
+release_out:
+	sock_release(hnew);
+	return ret;
+}
+
+static int skip_accept(struct socket *sock, struct socket *newsocket,
+		       int flags)
+{
+	int ret;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (!hsock)
+		return -EINVAL;
+
+	ret = skip_permit(ssk, SKIP_POLICY_INBOUND);
+	if (ret)
+		return ret;
+
+	/* mapped children need IPv4 names on IPv6 host sockets */
+	if ((ssk->map && hsock->sk->sk_family == AF_INET6) ||
+	    (ssk->nvmaps && READ_ONCE(accept_vaddr)))
+		return skip_accept_wrap(sock, newsocket, flags);
+
+	/* The child sock is grafted to newsocket by the host family
+	 * accept(). It is a plain host sock without skip sock, so
+	 * newsocket takes the host family ops instead of the
+	 * skip_proto_ops copied from the listener at accept(). Its
+	 * traffic is not counted, as of handed off sockets, and its
+	 * local name is the host address. */
+	if (ssk->nfanin)
+		ret = skip_accept_fanin(sock, newsocket, flags, &hsock);
+	else
+		ret = hsock->ops->accept(hsock, newsocket, flags);
+	if (ret)
+		return ret;
+
+	newsocket->ops = hsock->ops;
+	__module_get(newsocket->ops->owner);
+	module_put(THIS_MODULE);
+
+	skip_sk_stats_inc(ssk, accept);
+
+	return 0;
+}
+
+static int skip_map_getname(struct skip_sock *ssk, struct socket *hsock,
+			    struct sockaddr *addr, int *sockaddr_len,
+			    int peer)
+{
+	/* name of the IPv6 host socket of a mapped socket in IPv4 */
+
+	int ret, len;
+	struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+	struct sockaddr_in6 sin6;
+
+	ret = hsock->ops->getname(hsock, (struct sockaddr *)&sin6, &len,
+				  peer);
+	if (ret)
+		return ret;
+
+	*sockaddr_len = sizeof(*sin);
+
+	if (!peer && ssk->bound) {
+		/* the address bound, with the port the host chose */
+		memcpy(sin, &ssk->vaddr, sizeof(*sin));
+		sin->sin_port = sin6.sin6_port;
+		return 0;
+	}
+
+	if (skip_map_6to4(&ssk->map_prefix, &sin6, sin))
+		return 0;
+
+	if (!peer) {
+		/* IPv6 source chosen by the host */
+		memset(sin, 0, sizeof(*sin));
+		sin->sin_family = AF_INET;
+		sin->sin_port = sin6.sin6_port;
+		return 0;
+	}
+
+	/* peer out of the map prefix, e.g., a native IPv6 client */
+	memcpy(addr, &sin6, sizeof(sin6));
+	*sockaddr_len = sizeof(sin6);
+	return 0;
+}
+
+static int skip_getname(struct socket *sock, struct sockaddr *addr,
+			int *sockaddr_len, int peer)
+{
+	/* XXX: getname should be executed on vsock? */
+
+	int ret;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (!hsock) {
+		/* not bound yet, same as unbound AF_INET socket */
+		if (peer)
+			return -ENOTCONN;
+		memset(addr, 0, sizeof(struct sockaddr_in));
+		addr->sa_family = AF_INET;
+		*sockaddr_len = sizeof(struct sockaddr_in);
+		return 0;
+	}
+
+	if (!peer && ssk->any) {
+		/* wildcard address bound */
+		*sockaddr_len = skip_sockaddr_len((struct sockaddr *)
+						  &ssk->vaddr);
+		memcpy(addr, &ssk->vaddr, *sockaddr_len);
+		return 0;
+	}
+
+	if (ssk->map && hsock->sk->sk_family == AF_INET6)
+		return skip_map_getname(ssk, hsock, addr, sockaddr_len, peer);
+
+	ret = hsock->ops->getname(hsock, addr, sockaddr_len, peer);
+	if (!ret && ssk->nvmaps)
+		*sockaddr_len = skip_vmap_translate(ssk, addr, *sockaddr_len);
+
+	return ret;
+}
+
+static unsigned int skip_poll(struct file *file, struct socket *sock,
+			      struct poll_table_struct *wait)
+{
+	int n;
+	unsigned int mask, hmask;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (!hsock)
+		return datagram_poll(file, sock, wait);
+
+	/* Queue the waiter on the wait queue of this socket, that
+	 * the host sockets share (skip_hsock_share_wq()), and poll
+	 * them without a table. Newer kernels queue on the wait
+	 * queue of the struct socket given to ->poll(), that is
+	 * not the one hsk wakes up. */
+	if (!poll_does_not_wait(wait)) {
+		poll_wait(file, sk_sleep(sock->sk), wait);
+		smp_mb();	/* see sock_poll_wait() */
+	}
+
+	mask = hsock->ops->poll(file, hsock, NULL);
+	if (mask & POLLIN)
+		skip_mark_napi_id(sock->sk, hsock->sk);
+
+	for (n = 0; n < ssk->nfanin; n++) {
+		hmask = ssk->fanin[n]->ops->poll(file, ssk->fanin[n], NULL);
+		if (hmask & POLLIN)
+			skip_mark_napi_id(sock->sk, ssk->fanin[n]->sk);
+		mask |= hmask;
+	}
+
+	return mask;
+}
+
+
+static int skip_ioctl(struct socket *sock, unsigned int cmd,
+		      unsigned long arg)
+{
+	/* XXX: ioctl should be executed on both h/vsock? */
+
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (!hsock)
+		return -ENOTCONN;
+	WRITE_ONCE(ssk->recyclable, false);
+	return hsock->ops->ioctl(hsock, cmd, arg);
+}
+
+static int skip_listen(struct socket *sock, int len)
+{
+	/* XXX: ioctl should be executed on both h/vsock? */
+
+	int ret, n;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (!hsock)
+		return -EINVAL;	/* listen() requires bind() to skip */
+
+	ret = skip_permit(ssk, SKIP_POLICY_INBOUND);
+	if (ret)
+		return ret;
+
+	ret = hsock->ops->listen(hsock, len);
+	for (n = 0; n < ssk->nfanin && !ret; n++)
+		ret = ssk->fanin[n]->ops->listen(ssk->fanin[n], len);
+
+	return ret;
+}
+
+
+static int skip_shutdown(struct socket *sock, int flags)
+{
+	int n;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	/* accept()ed sockets use the host family ops directly (see
+	 * skip_accept()), so that only hsock->ops->shutdown is called
+	 * for sockets created by socket(). */
+	if (!hsock)
+		return -ENOTCONN;
+
+	for (n = 0; n < ssk->nfanin; n++)
+		ssk->fanin[n]->ops->shutdown(ssk->fanin[n], flags);
+
+	return hsock->ops->shutdown(hsock, flags);
+}
+
+static int skip_setsockopt(struct socket *sock, int level,
+			   int optname, char __user *optval,
+			   unsigned int optlen)
+{
+	/* XXX: setsockopt should be executed on both h/vsock? */
+
+	int ret, n;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (hsock) {
+		for (n = 0; n < ssk->nfanin; n++)
+			ssk->fanin[n]->ops->setsockopt(ssk->fanin[n], level,
+						       optname, optval,
+						       optlen);
+		goto hsock_out;
+	}
+
+	lock_sock(sock->sk);
+	hsock = ssk->hsock;
+	if (!hsock) {
+		ret = skip_sockopt_save(ssk, level, optname, optval, optlen);
+		release_sock(sock->sk);
+		if (ret)
+			return ret;
+
+		/* keep SOL_SOCKET options visible to getsockopt() until
+		 * hsock is created. the host socket may accept options
+		 * this socket does not, so that errors are ignored. */
+		if (level == SOL_SOCKET)
+			sock_setsockopt(sock, level, optname, optval, optlen);
+		return 0;
+	}
+	release_sock(sock->sk);
+
+hsock_out:
+	WRITE_ONCE(ssk->recyclable, false);
+	ret = hsock->ops->setsockopt(hsock, level, optname, optval, optlen);
+	if (level == SOL_SOCKET && !ret)
+		skip_busy_poll_sync(sock->sk, hsock->sk);
+
+	return ret;
+}
+
+static int skip_getsockopt(struct socket *sock, int level,
+			   int optname, char __user *optval,
+			   int __user * optlen)
+{
+	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
+
+	if (!hsock) {
+		if (level == SOL_SOCKET)
+			return sock_getsockopt(sock, level, optname,
+					       optval, optlen);
+		return -ENOPROTOOPT;
+	}
+	return hsock->ops->getsockopt(hsock, level, optname, optval, optlen);
+}
+
+static int skip_cmsg_4to6_type(struct msghdr *m, struct cmsghdr *cmsg)
+{
+	/* IPv6 type of a SOL_IP control message with the same
+	 * layout, or 0. IPv6 takes int only, IPv4 a byte of IP_TOS
+	 * as well. */
+
+	if (!CMSG_OK(m, cmsg) || cmsg->cmsg_level != SOL_IP ||
+	    cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+		return 0;
+
+	switch (cmsg->cmsg_type) {
+	case IP_TOS:
+		return IPV6_TCLASS;
+	case IP_TTL:
+		return IPV6_HOPLIMIT;
+	}
+	/* XXX: IP_PKTINFO needs struct in6_pktinfo */
 
-static inline struct skip_sock *skip_sk(const struct sock *sk)
+	return 0;
+}
+
+static void *skip_map_cmsg_4to6(struct msghdr *m)
 {
-	return (struct skip_sock *)sk;
+	/* the IPv6 host socket of a mapped IPv4 socket ignores
+	 * SOL_IP control messages. Rewrite those having the same
+	 * layout in IPv6, on a copy: m->msg_control is of the
+	 * caller, e.g., kernel_sendmsg() users that retry with it.
+	 * SOL_UDP and SOL_SOCKET ones are the same for both, and
+	 * others pass through. Returns the original m->msg_control
+	 * to restore after sending, or NULL if nothing to rewrite. */
+
+	int type;
+	void *control = m->msg_control, *copy;
+	struct cmsghdr *cmsg;
+
+	for_each_cmsghdr(cmsg, m) {
+		if (skip_cmsg_4to6_type(m, cmsg))
+			break;
+	}
+	if (!cmsg)
+		return NULL;
+
+	copy = kmemdup(control, m->msg_controllen, GFP_KERNEL);
+	if (!copy)
+		return ERR_PTR(-ENOBUFS);
+	m->msg_control = copy;
+
+	for_each_cmsghdr(cmsg, m) {
+		type = skip_cmsg_4to6_type(m, cmsg);
+		if (type) {
+			cmsg->cmsg_level = SOL_IPV6;
+			cmsg->cmsg_type = type;
+		}
+	}
+
+	return control;
 }
 
-static inline struct socket *skip_hsock(struct skip_sock *ssk)
+static int skip_send_bind(struct skip_sock *ssk, struct sockaddr *daddr)
 {
-	return ssk->hsock;
+	/* the first datagram of a socket not bound binds it through
+	 * the skip route toward daddr, as connect() does. A source
+	 * not on a skip route has no host address to send from. */
+
+	int ret;
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (hsock && inet_sk(hsock->sk)->inet_num)
+		return 0;
+
+	lock_sock(&ssk->sk);
+	ret = skip_connect_bind(ssk, skip_hsock_family(ssk, daddr->sa_family),
+				daddr);
+	release_sock(&ssk->sk);
+	if (ret == -ENONET)
+		ret = -EADDRNOTAVAIL;
+
+	return ret;
 }
 
-static inline struct socket *skip_vsock(struct skip_sock *ssk)
+static int skip_send_verdict(struct skip_sock *ssk, struct sockaddr *daddr)
 {
-	return ssk->vsock;
-}
+	/* a destination is rejected if the source the netns chooses
+	 * toward it is on a skip route not permitting outbound, or
+	 * not on a skip route at all */
 
+	int verdict = 0;
+	struct skip_lwt *slwt;
+	struct sockaddr_storage vsrc_s;
 
+	if (skip_route_saddr(sock_net(&ssk->sk), daddr, &vsrc_s))
+		return -EADDRNOTAVAIL;
 
-static int skip_release(struct socket *sock)
+	rcu_read_lock();
+	slwt = skip_lwt_lookup(sock_net(&ssk->sk),
+			       (struct sockaddr *)&vsrc_s);
+	if (!slwt)
+		verdict = -EADDRNOTAVAIL;
+	else if (!(slwt->host->policy & SKIP_POLICY_OUTBOUND))
+		verdict = -EPERM;
+	rcu_read_unlock();
+
+	return verdict;
+}
+
+static int skip_send_permit(struct skip_sock *ssk, struct sockaddr *daddr)
 {
-	struct sock *sk = sock->sk;
-	struct skip_sock *ssk;
+	/* per destination policy of unconnected sendmsg() on an
+	 * autobind socket, cached in ssk->dcache */
 
-	if (!sk) {
-		pr_debug("%s, NULL sk\n", __func__);
+	int verdict;
+	unsigned int seq;
+	u32 gen = skip_lwt_gen(sock_net(&ssk->sk));
+	union skip_inaddr addr;
+	struct skip_dcache *dc = READ_ONCE(ssk->dcache), *new;
+	struct skip_dcache_entry *e, ent;
+
+	if (!skip_inaddr_get(daddr, &addr))
 		return 0;
-	}
-	pr_debug("%s\n", __func__);
 
-	ssk = skip_sk(sk);
-	if (ssk->hsock)
-		sock_release(ssk->hsock);
-	if (ssk->vsock)
-		sock_release(ssk->vsock);
+	if (unlikely(!dc)) {
+		new = kzalloc(sizeof(*new), sk_gfp_mask(&ssk->sk, GFP_KERNEL));
+		if (!new)
+			return skip_send_verdict(ssk, daddr);
+		seqlock_init(&new->lock);
+		dc = cmpxchg(&ssk->dcache, NULL, new);
+		if (dc)
+			kfree(new);
+		else
+			dc = new;
+	}
 
-	sock_orphan(sk);
-	sk_refcnt_debug_release(sk);
-	sock_put(sk);
+	e = &dc->ent[hash_32(daddr->sa_family == AF_INET ?
+			     (__force u32)addr.a4 : ipv6_addr_hash(&addr.a6),
+			     SKIP_DCACHE_BITS)];
+	do {
+		seq = read_seqbegin(&dc->lock);
+		ent = *e;
+	} while (read_seqretry(&dc->lock, seq));
+
+	if (ent.gen == gen && ent.family == daddr->sa_family &&
+	    (ent.family == AF_INET ? ent.addr.a4 == addr.a4 :
+	     ipv6_addr_equal(&ent.addr.a6, &addr.a6))) {
+		verdict = ent.verdict;
+	} else {
+		verdict = skip_send_verdict(ssk, daddr);
+		write_seqlock(&dc->lock);
+		e->family = daddr->sa_family;
+		e->verdict = verdict;
+		e->gen = gen;
+		e->addr = addr;
+		write_sequnlock(&dc->lock);
+	}
 
-	sock->sk = NULL;
+	if (verdict == -EPERM)
+		skip_sk_stats_inc(ssk, reject_outbound);
 
-	return 0;
+	return verdict;
 }
 
-static int skip_find_lwtstate(struct socket *sock, struct sockaddr *daddr,
-			      struct skip_lwt *slwtp)
+static struct socket *skip_send_fanin(struct skip_sock *ssk,
+				      struct msghdr *m)
 {
-	/* find skip lwtunnel state */
+	/* host socket of a wildcard bound datagram socket to send a
+	 * datagram from: the one bound to the source address given
+	 * by IP_PKTINFO or IPV6_PKTINFO, or else the one that
+	 * received the last datagram, i.e., replies go out of the
+	 * host address the request came to. */
+
+	int n;
+	struct sock *hsk;
+	struct cmsghdr *cmsg;
+	struct in_pktinfo *pi;
+	struct in6_pktinfo *pi6;
+
+	for_each_cmsghdr(cmsg, m) {
+		if (!CMSG_OK(m, cmsg))
+			continue;
+
+		if (cmsg->cmsg_level == SOL_IP &&
+		    cmsg->cmsg_type == IP_PKTINFO &&
+		    cmsg->cmsg_len == CMSG_LEN(sizeof(*pi))) {
+			pi = (struct in_pktinfo *)CMSG_DATA(cmsg);
+			for (n = 0; n <= ssk->nfanin; n++) {
+				hsk = skip_hsock_n(ssk, n)->sk;
+				if (hsk->sk_family == AF_INET &&
+				    inet_sk(hsk)->inet_rcv_saddr ==
+				    pi->ipi_spec_dst.s_addr)
+					return skip_hsock_n(ssk, n);
+			}
+		} else if (cmsg->cmsg_level == SOL_IPV6 &&
+			   cmsg->cmsg_type == IPV6_PKTINFO &&
+			   cmsg->cmsg_len == CMSG_LEN(sizeof(*pi6))) {
+			pi6 = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+			for (n = 0; n <= ssk->nfanin; n++) {
+				hsk = skip_hsock_n(ssk, n)->sk;
+				if (hsk->sk_family == AF_INET6 &&
+				    ipv6_addr_equal(&hsk->sk_v6_rcv_saddr,
+						    &pi6->ipi6_addr))
+					return skip_hsock_n(ssk, n);
+			}
+		}
+	}
 
-	int ret = 0;
-	struct flowi4 fl4;
-	struct flowi6 fl6;
-	struct rtable *rt;
-	struct dst_entry *dst = NULL;
-	struct skip_lwt *slwt;
+	n = READ_ONCE(ssk->fanin_last);
+	return skip_hsock_n(ssk, n <= ssk->nfanin ? n : 0);
+}
 
-	switch (daddr->sa_family) {
-	case AF_INET:
-		memset(&fl4, 0, sizeof(fl4));
-		fl4.daddr = ((struct sockaddr_in *)daddr)->sin_addr.s_addr;
-		fl4.saddr = 0;	/* XXX: ? */
-		rt = ip_route_output_key(sock_net(sock->sk), &fl4);
-		if (IS_ERR(rt)) {
-			pr_debug("%s: no route found for %pI4\n",
-				 __func__, &fl4.daddr);
-			ret = -ENOENT;
-			goto out;
-		}
-		if (rt->dst.lwtstate == NULL ||
-		    rt->dst.lwtstate->type != LWTUNNEL_ENCAP_SKIP) {
-			pr_debug("%s: route to %pI4 is not skip\n",
-				 __func__, &fl4.daddr);
-			ret = -ENONET;
-			goto dst_release_out;
+static int skip_sendmsg(struct socket *sock,
+			struct msghdr *m, size_t total_len)
+{
+	int ret, namelen;
+	void *name, *control = NULL;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
+	struct sockaddr_in6 sin6;
+
+	/* unconnected datagrams: bind through the skip route on the
+	 * first one, and check the destinations of autobind sockets
+	 * after that. sockets bound by bind() send anywhere, e.g.,
+	 * replies of servers on inbound routes. */
+	if (m->msg_name && sock->type == SOCK_DGRAM &&
+	    m->msg_namelen >= sizeof(struct sockaddr_in)) {
+		if (unlikely(!ssk->bound && !ssk->map)) {
+			ret = skip_send_bind(ssk, m->msg_name);
+			if (ret)
+				return ret;
+			hsock = skip_hsock(ssk);
+		} else if (ssk->autobind) {
+			ret = skip_send_permit(ssk, m->msg_name);
+			if (ret)
+				return ret;
 		}
+	}
 
-		dst = &rt->dst;
-		break;
+	if (unlikely(!hsock)) {
+		if (!m->msg_name || m->msg_namelen < sizeof(sa_family_t))
+			return (sock->type == SOCK_STREAM) ?
+				-EPIPE : -EDESTADDRREQ;
 
-	case AF_INET6:
-		memset(&fl6, 0, sizeof(fl6));
-		fl6.daddr = ((struct sockaddr_in6 *)daddr)->sin6_addr;
-		dst = ip6_route_output(sock_net(sock->sk), sock->sk, &fl6);
-		if (dst->error) {
-			pr_debug("%s: no route found for %pI6\n",
-				 __func__, &fl6.daddr);
-			ret = -ENOENT;
-			goto out;
-		}
-		if (dst->lwtstate == NULL ||
-		    dst->lwtstate->type != LWTUNNEL_ENCAP_SKIP) {
-			pr_debug("%s: route to %pI6 is not skip\n",
-				 __func__, &fl6.daddr);
-			ret = -ENONET;
-			goto dst_release_out;
-		}
+		lock_sock(sock->sk);
+		ret = skip_hsock_create(ssk, skip_hsock_family(ssk,
+				((struct sockaddr *)m->msg_name)->sa_family));
+		release_sock(sock->sk);
+		if (ret)
+			return ret;
+		hsock = skip_hsock(ssk);
+	}
 
-		break;
+	if (ssk->nfanin && sock->type == SOCK_DGRAM)
+		hsock = skip_send_fanin(ssk, m);
 
-	default :
-		pr_err("%s: address family '%u' does not supported\n",
-		       __func__, daddr->sa_family);
-		return -EAFNOSUPPORT;
+	if (unlikely(ssk->map && m->msg_controllen) &&
+	    hsock->sk->sk_family == AF_INET6) {
+		control = skip_map_cmsg_4to6(m);
+		if (IS_ERR(control))
+			return PTR_ERR(control);
 	}
 
-	slwt = skip_lwt_lwtunnel(dst->lwtstate);
-	*slwtp = *slwt;
+	if (unlikely(m->msg_name &&
+		     skip_map_v4(ssk, hsock, m->msg_name, m->msg_namelen))) {
+		/* translate the destination, and restore it for the
+		 * caller after sending */
+		name = m->msg_name;
+		namelen = m->msg_namelen;
+		skip_map_4to6(&ssk->map_prefix, name, &sin6);
+		m->msg_name = &sin6;
+		m->msg_namelen = sizeof(sin6);
+		ret = hsock->ops->sendmsg(hsock, m, total_len);
+		m->msg_name = name;
+		m->msg_namelen = namelen;
+	} else
+		ret = hsock->ops->sendmsg(hsock, m, total_len);
+	if (unlikely(control)) {
+		kfree(m->msg_control);
+		m->msg_control = control;
+	}
+	if (ret > 0)
+		skip_sk_stats_add2(ssk, tx_packets, 1, tx_bytes, ret);
 
-dst_release_out:
-	dst_release(dst);
-out:
 	return ret;
 }
 
-static int skip_bind(struct socket *sock, struct sockaddr *uaddr, int addr_len)
+static void skip_recv_msg_name(struct skip_sock *ssk, struct msghdr *m)
 {
-	int ret, h_addrlen;
-	struct skip_lwt slwt;
-	struct skip_sock *ssk = skip_sk(sock->sk);
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	struct sockaddr_storage saddr_s;
-	struct sockaddr_in *sa4;
-	struct sockaddr_in6 *sa6;
-	//struct socket *vsock = skip_vsock(skip_sk(sock->sk));
+	/* translate the source address of a received datagram to
+	 * the address the container sees. m->msg_name is a kernel
+	 * buffer of sockaddr_storage. */
 
-	/* XXX:
-	 *
-	 * 1. Search routing table and find lwtunnel skip state.
-	 * 2. translate uaddr and addr_len and call bind() for hsock.
-	 * Then, call bind() to the socket on host netns.
-	 *
-	 * Consider carefully. 
-	 * - how to handle INADDR_ANY? i/o multiplex is required.
-	 * - bind() for virtual socket too?
-	 */
+	struct sockaddr_in6 sin6;
 
-	if (!uaddr)
-		return -EINVAL;
+	if (m->msg_namelen < sizeof(struct sockaddr_in))
+		return;
 
-	ret = skip_find_lwtstate(sock, uaddr, &slwt);
-	if (ret) {
-		pr_debug("%s: no skip route found\n", __func__);
-		return ret;
+	if (ssk->nvmaps) {
+		m->msg_namelen = skip_vmap_translate(ssk, m->msg_name,
+						     m->msg_namelen);
+		return;
 	}
 
-	memset(&saddr_s, 0, sizeof(saddr_s));
-	switch (slwt.host_family) {
-	case AF_INET:
-		sa4 = (struct sockaddr_in *)&saddr_s;
-		sa4->sin_family = AF_INET;
-		sa4->sin_addr.s_addr = slwt.host_addr4;
-		sa4->sin_port = ((struct sockaddr_in *)uaddr)->sin_port;
-		h_addrlen = sizeof(struct sockaddr_in);
-		break;
+	/* mapped socket, back to IPv4 */
+	if (m->msg_namelen != sizeof(sin6))
+		return;
 
-	case AF_INET6:
-		sa6 = (struct sockaddr_in6 *)&saddr_s;
-		sa6->sin6_family = AF_INET6;
-		sa6->sin6_addr = slwt.host_addr6;
-		sa6->sin6_port = ((struct sockaddr_in6 *)uaddr)->sin6_port;
-		h_addrlen = sizeof(struct sockaddr_in6);
-		break;
+	memcpy(&sin6, m->msg_name, sizeof(sin6));
+	if (sin6.sin6_family != AF_INET6)
+		return;
 
-	default :
-		pr_debug("%s: invalid family '%u' of skip route\n",
-			 __func__, slwt.host_family);
-		return -EAFNOSUPPORT;
-	}
+	if (skip_map_6to4(&ssk->map_prefix, &sin6, m->msg_name))
+		m->msg_namelen = sizeof(struct sockaddr_in);
+}
+
+static int skip_recvmsg_fanin(struct socket *sock,
+			      struct msghdr *m, size_t total_len, int flags)
+{
+	/* recvmsg() on any of host sockets of a wildcard bound
+	 * socket, mainly for datagrams. */
 
+	int ret, i, n;
+	unsigned int start;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock;
+	long timeo = sock_rcvtimeo(ssk->hsock->sk, flags & MSG_DONTWAIT);
+
+	n = ssk->nfanin + 1;
+
+	for (;;) {
+		start = READ_ONCE(ssk->fanin_next);
+		for (i = 0; i < n; i++) {
+			hsock = skip_hsock_n(ssk, (start + i) % n);
+			ret = hsock->ops->recvmsg(hsock, m, total_len,
+						  flags | MSG_DONTWAIT);
+			if (ret != -EAGAIN) {
+				WRITE_ONCE(ssk->fanin_next,
+					   (start + i + 1) % n);
+				if (ret >= 0)
+					WRITE_ONCE(ssk->fanin_last,
+						   (start + i) % n);
+				return ret;
+			}
+		}
 
-	ret = hsock->ops->bind(hsock, (struct sockaddr *)&saddr_s, h_addrlen);
-	if (ret) {
-		pr_debug("%s: hsock->ops->bind() failed, ret=%d\n",
-			 __func__, ret);
-		return ret;
+		ret = skip_fanin_wait(ssk, &timeo);
+		if (ret)
+			return ret;
 	}
+}
 
-	pr_debug("%s: bind success\n", __func__);
-	ssk->bound = true;	/* this socket is already bind()ed */
+static void skip_cmsg_recverr_6to4(void __user *control, size_t used,
+				   bool compat)
+{
+	/* rewrite SOL_IPV6/IPV6_RECVERR control messages that the
+	 * host socket put in the user buffer to SOL_IP/IP_RECVERR,
+	 * in place. The layout of struct sock_extended_err is the
+	 * same. */
+
+	size_t off, len;
+	struct cmsghdr ch;
+	struct cmsghdr __user *uch;
+#ifdef CONFIG_COMPAT
+	struct compat_cmsghdr cch;
+	struct compat_cmsghdr __user *ucch;
+#endif
 
-	return 0;
+	for (off = 0; off < used; off += len) {
+#ifdef CONFIG_COMPAT
+		if (compat) {
+			ucch = control + off;
+			if (used - off < sizeof(cch) ||
+			    copy_from_user(&cch, ucch, sizeof(cch)))
+				return;
+			if (cch.cmsg_level == SOL_IPV6 &&
+			    cch.cmsg_type == IPV6_RECVERR &&
+			    (put_user(SOL_IP, &ucch->cmsg_level) ||
+			     put_user(IP_RECVERR, &ucch->cmsg_type)))
+				return;
+			len = CMSG_COMPAT_ALIGN(cch.cmsg_len);
+			if (!len)
+				return;
+			continue;
+		}
+#endif
+		uch = control + off;
+		if (used - off < sizeof(ch) ||
+		    copy_from_user(&ch, uch, sizeof(ch)))
+			return;
+		if (ch.cmsg_level == SOL_IPV6 && ch.cmsg_type == IPV6_RECVERR &&
+		    (put_user(SOL_IP, &uch->cmsg_level) ||
+		     put_user(IP_RECVERR, &uch->cmsg_type)))
+			return;
+		len = CMSG_ALIGN(ch.cmsg_len);
+		if (!len)
+			return;
+	}
 }
 
-static int skip_connect(struct socket *sock, struct sockaddr *vaddr,
-			int sockaddr_len, int flags)
+static int skip_recv_errqueue_map(struct socket *hsock, struct msghdr *m,
+				  size_t total_len, int flags)
 {
+	/* the IPv6 host socket of a mapped IPv4 socket puts the error
+	 * as SOL_IPV6/IPV6_RECVERR, which the IPv4 user does not look
+	 * for. Receive into the user buffer as is, and translate the
+	 * control messages there after. */
+
 	int ret;
-	int h_addrlen;
-	struct skip_sock *ssk = skip_sk(sock->sk);
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	struct sockaddr_storage saddr_s;
+	void __user *control = (void __user *)m->msg_control;
+	size_t controllen = m->msg_controllen;
 
-	/* XXX: bind() should be called for vsock? */
+	ret = hsock->ops->recvmsg(hsock, m, total_len, flags);
+	if (ret < 0)
+		return ret;
 
-	if (sock->sk->sk_protocol == IPPROTO_UDP && !ssk->bound) {
-		/* bind(port 0) before connect() for SOCK_DRGAM
-		 * sockets to prevent container from using addresses
-		 * not assinged to this container */
-		memcpy(&saddr_s, vaddr, sockaddr_len);
-		switch (saddr_s.ss_family){
-		case AF_INET:
-			((struct sockaddr_in*)&saddr_s)->sin_port = 0;
-			h_addrlen = sizeof(struct sockaddr_in);
-			break;
-		case AF_INET6:
-			((struct sockaddr_in6*)&saddr_s)->sin6_port = 0;
-			h_addrlen = sizeof(struct sockaddr_in6);
-			break;
-		default:
-			pr_debug("%s: invalid family '%u' of skip route\n",
-				 __func__, saddr_s.ss_family);
-			return -EAFNOSUPPORT;
-		}
-		ret = hsock->ops->bind(hsock, (struct sockaddr *)&saddr_s,
-				       h_addrlen);
-		if (ret) {
-			pr_debug("%s: bind() before connect failed '%d'\n",
-				 __func__, ret);
-			return ret;
-		}
-	}
+	skip_cmsg_recverr_6to4(control, controllen - m->msg_controllen,
+			       flags & MSG_CMSG_COMPAT);
 
-	return hsock->ops->connect(hsock, vaddr, sockaddr_len, flags);
+	return ret;
 }
 
-static int skip_socketpair(struct socket *sock1, struct socket *sock2)
+static int skip_recv_errqueue(struct skip_sock *ssk, struct msghdr *m,
+			      size_t total_len, int flags)
 {
-	/* XXX: ??? */
+	/* MSG_ERRQUEUE: TX timestamps and ICMP errors are queued on
+	 * the host socket that sent the packet, which may be any of
+	 * the fanin sockets. Reading the error queue never blocks. */
+
+	int n, ret = -EAGAIN;
+	struct socket *hsock;
+
+	for (n = 0; n <= ssk->nfanin && ret == -EAGAIN; n++) {
+		hsock = skip_hsock_n(ssk, n);
+		if (unlikely(ssk->map) && hsock->sk->sk_family == AF_INET6)
+			ret = skip_recv_errqueue_map(hsock, m, total_len,
+						     flags);
+		else
+			ret = hsock->ops->recvmsg(hsock, m, total_len, flags);
+	}
 
-	struct socket *hsock = skip_hsock(skip_sk(sock1->sk));
-	return hsock->ops->socketpair(hsock, sock2);
-}
+	if (unlikely(ssk->map || ssk->nvmaps) && ret >= 0 && m->msg_name)
+		skip_recv_msg_name(ssk, m);
 
-static int skip_accept(struct socket *sock, struct socket *newsocket,
-		       int flags)
-{
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));	
-	return hsock->ops->accept(hsock, newsocket, flags);
+	return ret;
 }
 
-static int skip_getname(struct socket *sock, struct sockaddr *addr,
-			int *sockaddr_len, int peer)
+static int skip_recvmsg(struct socket *sock,
+			struct msghdr *m, size_t total_len, int flags)
 {
-	/* XXX: getname should be executed on vsock? */
+	int ret;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
 
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));	
-	return hsock->ops->getname(hsock, addr, sockaddr_len, peer);
-}
+	if (!hsock)
+		return -ENOTCONN;
 
-static unsigned int skip_poll(struct file *file, struct socket *sock,
-			      struct poll_table_struct *wait)
-{
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));	
-	return hsock->ops->poll(file, hsock, wait);
-}
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return skip_recv_errqueue(ssk, m, total_len, flags);
 
+	if (ssk->nfanin)
+		ret = skip_recvmsg_fanin(sock, m, total_len, flags);
+	else {
+		ret = hsock->ops->recvmsg(hsock, m, total_len, flags);
+		if (ret > 0)
+			skip_mark_napi_id(sock->sk, hsock->sk);
+	}
 
-static int skip_ioctl(struct socket *sock, unsigned int cmd,
-		      unsigned long arg)
-{
-	/* XXX: ioctl should be executed on both h/vsock? */
+	if (unlikely(ssk->map || ssk->nvmaps) && ret >= 0 && m->msg_name)
+		skip_recv_msg_name(ssk, m);
 
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	return hsock->ops->ioctl(hsock, cmd, arg);
+	if (ret > 0)
+		skip_sk_stats_add2(ssk, rx_packets, 1, rx_bytes, ret);
+
+	return ret;
 }
 
-static int skip_listen(struct socket *sock, int len)
+static ssize_t skip_sendpage(struct socket *sock, struct page *page,
+			     int offset, size_t size, int flags)
 {
-	/* XXX: ioctl should be executed on both h/vsock? */
+	ssize_t ret;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
 
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	return hsock->ops->listen(hsock, len);
+	if (!hsock)
+		return -EPIPE;
+
+	ret = hsock->ops->sendpage(hsock, page, offset, size, flags);
+	if (ret > 0) {
+		skip_sk_stats_add2(ssk, tx_packets, 1, tx_bytes, ret);
+	}
+
+	return ret;
 }
 
 
-static int skip_shutdown(struct socket *sock, int flags)
+static ssize_t skip_splice_read(struct socket *sock, loff_t *ppos,
+			       struct pipe_inode_info *pipe,
+			       size_t len, unsigned int flags)
 {
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
+	ssize_t ret;
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
 
-	/* XXX:
-	 * shutdown() is called for socket accept()ed.
-	 * accept() sockets do not have virtual socket on netns.
-	 * Thus, in this function, only hsock->ops->shutdown is called.
-	 */
-	return hsock->ops->shutdown(hsock, flags);
-}
+	if (!hsock)
+		return -ENOTCONN;
 
-static int skip_setsockopt(struct socket *sock, int level,
-			   int optname, char __user *optval,
-			   unsigned int optlen)
-{
-	/* XXX: setsockopt should be executed on both h/vsock? */
+	ret = hsock->ops->splice_read(hsock, ppos, pipe, len, flags);
+	if (ret > 0) {
+		skip_sk_stats_add2(ssk, rx_packets, 1, rx_bytes, ret);
+	}
 
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	return hsock->ops->setsockopt(hsock, level, optname, optval, optlen);
+	return ret;
 }
 
-static int skip_getsockopt(struct socket *sock, int level,
-			   int optname, char __user *optval,
-			   int __user * optlen)
+static int skip_read_sock(struct sock *sk, read_descriptor_t *desc,
+			  sk_read_actor_t recv_actor)
 {
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	return hsock->ops->getsockopt(hsock, level, optname, optval, optlen);
-}
+	/* in-kernel readers (strparser, KCM) read the receive queue
+	 * of the host socket. The lock of the skip socket the caller
+	 * may hold does not keep softirq off hsk. From the relay (BH
+	 * disabled), hsk is locked by its receive path or owned while
+	 * its backlog is processed. Otherwise (e.g., strparser work)
+	 * lock it here. */
 
-static int skip_sendmsg(struct socket *sock,
-			struct msghdr *m, size_t total_len)
-{
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	
-	/* XXX: impliment bind() before connect()/send*() !! */
-	return hsock->ops->sendmsg(hsock, m, total_len);
-}
+	int ret;
+	bool locked;
+	struct skip_sock *ssk = skip_sk(sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (!hsock)
+		return -ENOTCONN;
+	if (!hsock->ops->read_sock)
+		return -EOPNOTSUPP;
+
+	skip_hsock_relay(ssk);
+
+	locked = !in_softirq();
+	if (locked)
+		lock_sock(hsock->sk);
+	ret = hsock->ops->read_sock(hsock->sk, desc, recv_actor);
+	if (locked)
+		release_sock(hsock->sk);
+	if (ret > 0) {
+		skip_sk_stats_add2(ssk, rx_packets, 1, rx_bytes, ret);
+	}
 
-static int skip_recvmsg(struct socket *sock,
-			struct msghdr *m, size_t total_len, int flags)
-{
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	return hsock->ops->recvmsg(hsock, m, total_len, flags);
+	return ret;
 }
 
-static ssize_t skip_sendpage(struct socket *sock, struct page *page,
-			     int offset, size_t size, int flags)
+static int skip_peek_len(struct socket *sock)
 {
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	return hsock->ops->sendpage(hsock, page, offset, size, flags);
-}
+	struct skip_sock *ssk = skip_sk(sock->sk);
+	struct socket *hsock = skip_hsock(ssk);
 
+	if (!hsock)
+		return -ENOTCONN;
+	if (!hsock->ops->peek_len)
+		return -EOPNOTSUPP;
 
-static ssize_t skip_splice_read(struct socket *sock, loff_t *ppos,
-			       struct pipe_inode_info *pipe,
-			       size_t len, unsigned int flags)
-{
-	struct socket *hsock = skip_hsock(skip_sk(sock->sk));
-	return hsock->ops->splice_read(hsock, ppos, pipe, len, flags);
+	skip_hsock_relay(ssk);
+
+	return hsock->ops->peek_len(hsock);
 }
 
 static int skip_set_peek_off(struct sock *sk, int val)
 {
 	/* XXX: set_peek_off should be executed on both h/vsock? */
 
-	struct socket *hsock = skip_hsock(skip_sk(sk));
+	struct skip_sock *ssk = skip_sk(sk);
+	struct socket *hsock = skip_hsock(ssk);
+
+	if (!hsock)
+		return -ENOTCONN;
+	WRITE_ONCE(ssk->recyclable, false);
 	return hsock->ops->set_peek_off(hsock->sk, val);
 }
 
@@ -405,50 +2468,81 @@ static const struct proto_ops skip_proto_ops = {
 	.sendpage	= skip_sendpage,
 	.splice_read	= skip_splice_read,
 	.set_peek_off	= skip_set_peek_off,
+	.read_sock	= skip_read_sock,
+	.peek_len	= skip_peek_len,
 };
 
+static void skip_release_cb(struct sock *sk)
+{
+	/* release_sock() of sock_fasync() among others */
+	skip_hsock_sync_fasync(skip_sk(sk));
+}
+
 static struct proto skip_proto = {
 	.name		= "SKIP",
 	.owner		= THIS_MODULE,
+	.release_cb	= skip_release_cb,
 	.obj_size	= sizeof(struct skip_sock),
 };
 
-static int skip_create(struct net *net, struct socket *sock,
-		       int protocol, int kern)
+static struct sock *skip_sk_alloc(struct net *net, struct socket *sock,
+				  int protocol, int kern)
 {
-	int ret;
 	struct sock *sk;
 	struct skip_sock *ssk;
 
-	pr_debug("%s\n", __func__);
-
-	sock->ops = &skip_proto_ops;
-
 	sk = sk_alloc(net, PF_SKIP, GFP_KERNEL, &skip_proto, kern);
 	if (!sk)
-		return -ENOMEM;
+		return NULL;
 
 	sock_init_data(sock, sk);
+	sk->sk_protocol = protocol;
 
 	ssk = skip_sk(sk);
 	ssk->sock = sock;
 	ssk->bound = false;
+	ssk->autobind = false;
+	ssk->recyclable = false;
+	ssk->kern = kern;
+	ssk->hcred = NULL;
+	ssk->hsock = NULL;
+	ssk->vsock = NULL;
+	RCU_INIT_POINTER(ssk->stats, NULL);
+	ssk->policy = SKIP_POLICY_ANY;
+	ssk->srcs = NULL;
+	ssk->hnet = NULL;
+	ssk->gen = 0;
+	ssk->stale = false;
+	ssk->any = false;
+	ssk->nfanin = 0;
+	ssk->fanin_next = 0;
+	ssk->fanin_last = 0;
+	ssk->map = false;
+	ssk->nvmaps = 0;
+	ssk->vmaps = NULL;
+	ssk->hsk_data_ready = NULL;
+	ssk->def_data_ready = sk->sk_data_ready;
+	ssk->dcache = NULL;
+	INIT_LIST_HEAD(&ssk->sockopts);
+
+	skip_diag_link(sk);
+
+	return sk;
+}
 
-	/* XXX:
-	 * 
-	 * actual sockets (on both netns and defualt netns) are
-	 * created when any one of bind(), connect(), sendto/msg() are
-	 * called.
-	 */
-	ret = __sock_create(get_net(&init_net),
-			    AF_INET, sk->sk_type, sk->sk_protocol,
-			    &ssk->hsock, kern);
-	if (ret < 0) {
-		pr_err("%s: failed to create a socket on default netns\n",
-		       __func__);
-		sk_free(sk);
-		return ret;
-	}
+static int skip_create(struct net *net, struct socket *sock,
+		       int protocol, int kern)
+{
+	pr_debug("%s\n", __func__);
+
+	sock->ops = &skip_proto_ops;
+
+	if (!skip_sk_alloc(net, sock, protocol, kern))
+		return -ENOMEM;
+
+	/* actual sockets on host netns are created when any one of
+	 * bind(), connect(), sendto/msg() is called, with the family
+	 * of the host address. */
 
 	return 0;
 }
@@ -2,12 +2,293 @@
 #ifndef _SKIP_H_
 #define _SKIP_H_
 
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
+#include <linux/bottom_half.h>
+#include <linux/seqlock.h>
+#include <linux/in6.h>
+#include <net/sock.h>
+
 #define SKIP_VERSION "0.0.0"
 
+struct net;
+struct socket;
+struct sockaddr;
+struct sockaddr_storage;
+struct skip_lwt;
+
 int skip_lwt_init(void);
 void skip_lwt_exit(void);
 
+/* per-route counters. sockets hold a reference to the counters of
+ * the route they are bound through. Traffic of sockets that are not
+ * skip sockets anymore, i.e., handed off ones and children accepted
+ * with the host family ops, is not counted. */
+struct skip_pcpu_stats {
+	u64	bind;
+	u64	connect;
+	u64	accept;
+	u64	tx_packets;
+	u64	tx_bytes;
+	u64	rx_packets;
+	u64	rx_bytes;
+	u64	lookup_fail;
+	u64	reject_inbound;
+	u64	reject_outbound;
+	u64	pkt_output;
+	u64	pkt_input;
+	u64	pkt_drop;
+
+	struct u64_stats_sync syncp;
+};
+
+struct skip_stats {
+	atomic_t		refcnt;
+	struct rcu_head		rcu;
+	struct skip_pcpu_stats __percpu *pcpu;
+};
+
+/* updated from process context (socket calls, output) and softirq
+ * (input). BHs are off around the update, as a softirq writer
+ * nesting in another on the same CPU breaks the u64_stats seqcount
+ * on 32-bit. */
+#define skip_stats_add(stats, field, val)				\
+	do {								\
+		struct skip_pcpu_stats *__s;				\
+		if (!(stats))						\
+			break;						\
+		local_bh_disable();					\
+		__s = this_cpu_ptr((stats)->pcpu);			\
+		u64_stats_update_begin(&__s->syncp);			\
+		__s->field += (val);					\
+		u64_stats_update_end(&__s->syncp);			\
+		local_bh_enable();					\
+	} while (0)
+
+#define skip_stats_inc(stats, field)	skip_stats_add(stats, field, 1)
+
+/* packets and bytes in one update, for the data path */
+#define skip_stats_add2(stats, f1, v1, f2, v2)				\
+	do {								\
+		struct skip_pcpu_stats *__s;				\
+		if (!(stats))						\
+			break;						\
+		local_bh_disable();					\
+		__s = this_cpu_ptr((stats)->pcpu);			\
+		u64_stats_update_begin(&__s->syncp);			\
+		__s->f1 += (v1);					\
+		__s->f2 += (v2);					\
+		u64_stats_update_end(&__s->syncp);			\
+		local_bh_enable();					\
+	} while (0)
+
+/* must be called under rcu_read_lock() */
+struct skip_stats *skip_lwt_stats_get(struct skip_lwt *slwt);
+void skip_stats_put(struct skip_stats *stats);
+
+union skip_inaddr {
+	__be32		a4;
+	struct in6_addr	a6;
+};
+
+/* source address pool of a route. sockets bound through the route
+ * hold a reference, like skip_stats. */
+struct skip_addr_list {
+	atomic_t		refcnt;
+	struct rcu_head		rcu;
+	int			family;
+	int			count;
+	union skip_inaddr	addr[];
+};
+
+/* must be called under rcu_read_lock() */
+struct skip_addr_list *skip_lwt_addr_list_get(struct skip_lwt *slwt);
+void skip_addr_list_put(struct skip_addr_list *list);
+
+/* max number of host addresses a wildcard bind() listens on */
+#define SKIP_FANIN_MAX		16
+
+/* host addresses of the inbound skip routes of a netns, for
+ * wildcard bind */
+struct skip_host_addrs {
+	int count;
+	u8 policy;		/* union of the route policies */
+	struct net *net;	/* of the host sockets, referenced */
+	struct sockaddr_storage addrs[SKIP_FANIN_MAX];
+	struct sockaddr_storage vaddrs[SKIP_FANIN_MAX];
+};
+
+/* must be called under rcu_read_lock() */
+struct skip_lwt *skip_lwt_lookup(struct net *net, struct sockaddr *addr);
+int skip_lwt_host_addrs(struct net *net, int family,
+			struct skip_host_addrs *ha);
+u32 skip_lwt_gen(struct net *net);
+bool skip_lwt_map_prefix(struct net *net, struct in6_addr *prefix);
+
+/* AF_SKIP socket (af_skip.c) */
+
+/* a host address of a socket and the virtual address the container
+ * sees instead in getsockname(), getpeername() and recvmsg() */
+struct skip_vmap {
+	sa_family_t		hfamily;
+	sa_family_t		vfamily;
+	union skip_inaddr	host;
+	union skip_inaddr	virt;
+};
+
+/* verdicts of unconnected sendmsg() per destination, so that the
+ * route lookup of the source is not paid per datagram. entries of
+ * an older skip_lwt_gen() are misses. */
+#define SKIP_DCACHE_BITS	4
+
+struct skip_dcache_entry {
+	sa_family_t		family;
+	int			verdict;	/* 0 or -EPERM */
+	u32			gen;
+	union skip_inaddr	addr;
+};
+
+struct skip_dcache {
+	seqlock_t		lock;
+	struct skip_dcache_entry ent[1 << SKIP_DCACHE_BITS];
+};
+
+struct skip_sock {
+	struct sock sk;
+
+	bool bound;		/* bind() is called or not */
+	bool autobind;		/* bound by connect() or sendmsg() */
+	bool handoff;		/* hand hsock over after bind/connect */
+	bool recyclable;	/* hsock goes to the pool on close */
+	int kern;		/* created by kernel or not */
+	const struct cred *hcred;	/* created hsock, see skip_pool.c */
+
+	struct socket *sock;	/* this socket */
+
+	struct socket *vsock;	/* socket with original family at namespace */
+	struct socket *hsock;	/* socket with original family at host */
+
+	struct list_head sockopts;	/* pending skip_sockopt */
+
+	/* sk_data_ready() of hsock replaced by the relay for in-kernel
+	 * readers of this socket. see skip_hsock_relay(). */
+	void (*hsk_data_ready)(struct sock *sk);
+	/* of sock_init_data(), waking up the wait queue shared with
+	 * hsock. see skip_hsock_share_wq(). */
+	void (*def_data_ready)(struct sock *sk);
+
+	/* of the route bound through. replaced by skip_revalidate()
+	 * under lock_sock() while other threads count on it, see
+	 * skip_sk_stats_add(). */
+	struct skip_stats __rcu *stats;
+	u8 policy;			/* SKIP_POLICY_* of the route */
+	struct skip_addr_list *srcs;	/* source pool, see skip_srcs_bind() */
+	struct net *hnet;		/* of hsock, referenced. or init_net */
+
+	/* skip_lwt_gen() when the route was resolved, and the route
+	 * has gone since then. see skip_revalidate(). */
+	u32 gen;
+	bool stale;
+
+	/* wildcard bind. hsock and fanin[] are bound to all host
+	 * addresses of the skip routes, and accept() and recvmsg()
+	 * multiplex them. see skip_bind_any(). */
+	bool any;
+	int nfanin;
+	unsigned int fanin_next;
+	int fanin_last;		/* received the last datagram */
+	struct socket *fanin[SKIP_FANIN_MAX - 1];
+	struct sockaddr_storage vaddr;	/* virtual address bound */
+
+	/* host to virtual address mappings. vmaps is &vmap, or an
+	 * array for a wildcard bind. nvmaps is 0 if nothing to
+	 * translate. */
+	int nvmaps;
+	struct skip_vmap *vmaps;
+	struct skip_vmap vmap;
+
+	/* IPv4 socket on IPv6 host sockets (v4v6map). IPv4
+	 * addresses are embedded in the low 32 bits of map_prefix. */
+	bool map;
+	struct in6_addr map_prefix;
+
+	/* of an autobind socket, see skip_send_permit() */
+	struct skip_dcache *dcache;
+};
+
+static inline struct skip_sock *skip_sk(const struct sock *sk)
+{
+	return (struct skip_sock *)sk;
+}
+
+/* count on the counters of a socket */
+#define skip_sk_stats_add(ssk, field, val)				\
+	do {								\
+		struct skip_stats *__st;				\
+		rcu_read_lock();					\
+		__st = rcu_dereference((ssk)->stats);			\
+		skip_stats_add(__st, field, val);			\
+		rcu_read_unlock();					\
+	} while (0)
+
+#define skip_sk_stats_inc(ssk, field)	skip_sk_stats_add(ssk, field, 1)
+
+#define skip_sk_stats_add2(ssk, f1, v1, f2, v2)				\
+	do {								\
+		struct skip_stats *__st;				\
+		rcu_read_lock();					\
+		__st = rcu_dereference((ssk)->stats);			\
+		skip_stats_add2(__st, f1, v1, f2, v2);			\
+		rcu_read_unlock();					\
+	} while (0)
+
+/* a reference of the counters of a socket, or NULL */
+static inline struct skip_stats *skip_sk_stats_get(struct skip_sock *ssk)
+{
+	struct skip_stats *stats;
+
+	rcu_read_lock();
+	stats = rcu_dereference(ssk->stats);
+	if (stats && !atomic_inc_not_zero(&stats->refcnt))
+		stats = NULL;
+	rcu_read_unlock();
+
+	return stats;
+}
+
+static inline struct socket *skip_hsock(struct skip_sock *ssk)
+{
+	/* hsock is created lazily, paired with smp_store_release()
+	 * in skip_hsock_create(). NULL until the first bind(),
+	 * connect() or sendmsg(). */
+	return smp_load_acquire(&ssk->hsock);
+}
+
+static inline struct socket *skip_vsock(struct skip_sock *ssk)
+{
+	return ssk->vsock;
+}
+
+static inline struct socket *skip_hsock_n(struct skip_sock *ssk, int n)
+{
+	/* n-th host socket of a wildcard bound socket. 0 is hsock */
+	return n ? ssk->fanin[n - 1] : ssk->hsock;
+}
+
 int af_skip_init(void);
 void af_skip_exit(void);
+void skip_sock_reset(struct sock *sk);
+
+int skip_pool_init(void);
+void skip_pool_exit(void);
+bool skip_pool_active(void);
+struct socket *skip_pool_get(int family, int type, int protocol);
+bool skip_pool_put(struct socket *sock, const struct cred *cred);
+
+int skip_diag_init(void);
+void skip_diag_exit(void);
+void skip_diag_link(struct sock *sk);
+void skip_diag_unlink(struct sock *sk);
+void skip_diag_reset(struct skip_stats *stats);
 
 #endif
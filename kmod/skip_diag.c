@@ -0,0 +1,487 @@
+/* skip_diag.c
+ *
+ * skip over socket processing :
+ *
+ * sock_diag handler of AF_SKIP sockets. A skip socket is dumped
+ * with the netns id of the namespace it is opened at, the virtual
+ * address it is bound to, and inet_diag_msg of its host socket on
+ * the default netns. The host socket can be filtered with
+ * inet_diag bytecode, the same as `ss` uses for TCP and UDP.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <net/sock.h>
+#include <net/inet_sock.h>
+#include <net/netlink.h>
+#include <net/net_namespace.h>
+
+#include <skip_diag.h>
+#include <af_skip.h>
+
+#include "skip.h"
+
+
+#ifdef pr_fmt
+#undef pr_fmt
+#endif
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+
+/* all skip sockets, hashed by address of sock to spread the lock */
+#define SKIP_DIAG_HASH_BITS	6
+#define SKIP_DIAG_HASH_SIZE	(1 << SKIP_DIAG_HASH_BITS)
+
+struct skip_diag_bucket {
+	spinlock_t		lock;
+	struct hlist_head	head;
+};
+
+static struct skip_diag_bucket skip_diag_hash[SKIP_DIAG_HASH_SIZE];
+
+
+static struct skip_diag_bucket *skip_diag_bucket(struct sock *sk)
+{
+	return &skip_diag_hash[hash_ptr(sk, SKIP_DIAG_HASH_BITS)];
+}
+
+void skip_diag_link(struct sock *sk)
+{
+	struct skip_diag_bucket *b = skip_diag_bucket(sk);
+
+	spin_lock(&b->lock);
+	sk_add_node(sk, &b->head);
+	spin_unlock(&b->lock);
+}
+
+void skip_diag_unlink(struct sock *sk)
+{
+	struct skip_diag_bucket *b = skip_diag_bucket(sk);
+
+	spin_lock(&b->lock);
+	sk_del_node_init(sk);
+	spin_unlock(&b->lock);
+}
+
+void skip_diag_reset(struct skip_stats *stats)
+{
+	/* reset the skip sockets holding the counters of a deleted
+	 * route. skip_sock_reset() sleeps, so that the sockets of a
+	 * bucket are taken out of the lock first. */
+
+	int n, i, count, max;
+	struct sock *sk, **sks;
+	struct skip_diag_bucket *b;
+
+	for (n = 0; n < SKIP_DIAG_HASH_SIZE; n++) {
+		b = &skip_diag_hash[n];
+
+		max = 0;
+		spin_lock(&b->lock);
+		sk_for_each(sk, &b->head)
+			if (rcu_access_pointer(skip_sk(sk)->stats) == stats)
+				max++;
+		spin_unlock(&b->lock);
+		if (!max)
+			continue;
+
+		sks = kmalloc_array(max, sizeof(*sks), GFP_KERNEL);
+		if (!sks)
+			continue;
+
+		count = 0;
+		spin_lock(&b->lock);
+		sk_for_each(sk, &b->head) {
+			if (rcu_access_pointer(skip_sk(sk)->stats) != stats)
+				continue;
+			sock_hold(sk);
+			sks[count++] = sk;
+			if (count == max)
+				break;
+		}
+		spin_unlock(&b->lock);
+
+		for (i = 0; i < count; i++) {
+			skip_sock_reset(sks[i]);
+			sock_put(sks[i]);
+		}
+		kfree(sks);
+	}
+}
+
+
+/* inet_diag_bc_audit() is static in inet_diag.c. This is the same
+ * validation, for inet_diag_bc_sk() to run the bytecode safely. */
+
+static bool skip_diag_valid_cc(const void *bc, int len, int cc)
+{
+	while (len >= 0) {
+		const struct inet_diag_bc_op *op = bc;
+
+		if (cc > len)
+			return false;
+		if (cc == len)
+			return true;
+		if (op->yes < 4 || op->yes & 3)
+			return false;
+		len -= op->yes;
+		bc += op->yes;
+	}
+	return false;
+}
+
+static bool skip_diag_valid_hostcond(const struct inet_diag_bc_op *op,
+				     int len, int *min_len)
+{
+	struct inet_diag_hostcond *cond;
+	int addr_len;
+
+	*min_len += sizeof(struct inet_diag_hostcond);
+	if (len < *min_len)
+		return false;
+
+	cond = (struct inet_diag_hostcond *)(op + 1);
+	switch (cond->family) {
+	case AF_UNSPEC:
+		addr_len = 0;
+		break;
+	case AF_INET:
+		addr_len = sizeof(struct in_addr);
+		break;
+	case AF_INET6:
+		addr_len = sizeof(struct in6_addr);
+		break;
+	default:
+		return false;
+	}
+
+	*min_len += addr_len;
+	if (len < *min_len)
+		return false;
+
+	return cond->prefix_len <= 8 * addr_len;
+}
+
+static int skip_diag_bc_audit(const struct nlattr *attr,
+			      const struct sk_buff *skb)
+{
+	bool net_admin = netlink_net_capable(skb, CAP_NET_ADMIN);
+	const void *bytecode, *bc;
+	int bytecode_len, len;
+
+	if (nla_len(attr) < sizeof(struct inet_diag_bc_op))
+		return -EINVAL;
+
+	bytecode = bc = nla_data(attr);
+	len = bytecode_len = nla_len(attr);
+
+	while (len > 0) {
+		int min_len = sizeof(struct inet_diag_bc_op);
+		const struct inet_diag_bc_op *op = bc;
+
+		switch (op->code) {
+		case INET_DIAG_BC_S_COND:
+		case INET_DIAG_BC_D_COND:
+			if (!skip_diag_valid_hostcond(bc, len, &min_len))
+				return -EINVAL;
+			break;
+		case INET_DIAG_BC_DEV_COND:
+			min_len += sizeof(u32);
+			if (len < min_len)
+				return -EINVAL;
+			break;
+		case INET_DIAG_BC_S_GE:
+		case INET_DIAG_BC_S_LE:
+		case INET_DIAG_BC_D_GE:
+		case INET_DIAG_BC_D_LE:
+			min_len += sizeof(struct inet_diag_bc_op);
+			if (len < min_len)
+				return -EINVAL;
+			break;
+		case INET_DIAG_BC_MARK_COND:
+			if (!net_admin)
+				return -EPERM;
+			min_len += sizeof(struct inet_diag_markcond);
+			if (len < min_len)
+				return -EINVAL;
+			break;
+		case INET_DIAG_BC_AUTO:
+		case INET_DIAG_BC_JMP:
+		case INET_DIAG_BC_NOP:
+			break;
+		default:
+			return -EINVAL;
+		}
+
+		if (op->code != INET_DIAG_BC_NOP) {
+			if (op->no < min_len || op->no > len + 4 || op->no & 3)
+				return -EINVAL;
+			if (op->no < len &&
+			    !skip_diag_valid_cc(bytecode, bytecode_len,
+						len - op->no))
+				return -EINVAL;
+		}
+
+		if (op->yes < min_len || op->yes > len + 4 || op->yes & 3)
+			return -EINVAL;
+		bc += op->yes;
+		len -= op->yes;
+	}
+
+	return len == 0 ? 0 : -EINVAL;
+}
+
+
+static int skip_diag_protocol(struct sock *sk, struct sock *hsk)
+{
+	if (hsk)
+		return hsk->sk_protocol;
+	if (sk->sk_protocol)
+		return sk->sk_protocol;
+
+	/* socket(AF_SKIP, type, 0) not bound yet */
+	switch (sk->sk_type) {
+	case SOCK_STREAM:
+		return IPPROTO_TCP;
+	case SOCK_DGRAM:
+		return IPPROTO_UDP;
+	}
+	return 0;
+}
+
+static void skip_diag_fill_host(struct sock *hsk, struct inet_diag_msg *r,
+				struct user_namespace *user_ns)
+{
+	struct inet_sock *inet = inet_sk(hsk);
+
+	memset(r, 0, sizeof(*r));
+
+	r->idiag_family = hsk->sk_family;
+	r->idiag_state = hsk->sk_state;
+	r->id.idiag_sport = inet->inet_sport;
+	r->id.idiag_dport = inet->inet_dport;
+	r->id.idiag_if = hsk->sk_bound_dev_if;
+	sock_diag_save_cookie(hsk, r->id.idiag_cookie);
+
+#if IS_ENABLED(CONFIG_IPV6)
+	if (hsk->sk_family == AF_INET6) {
+		*(struct in6_addr *)r->id.idiag_src = hsk->sk_v6_rcv_saddr;
+		*(struct in6_addr *)r->id.idiag_dst = hsk->sk_v6_daddr;
+	} else
+#endif
+	{
+		r->id.idiag_src[0] = inet->inet_rcv_saddr;
+		r->id.idiag_dst[0] = inet->inet_daddr;
+	}
+
+	if (hsk->sk_state == TCP_LISTEN) {
+		r->idiag_rqueue = hsk->sk_ack_backlog;
+		r->idiag_wqueue = hsk->sk_max_ack_backlog;
+	} else {
+		r->idiag_rqueue = sk_rmem_alloc_get(hsk);
+		r->idiag_wqueue = sk_wmem_alloc_get(hsk);
+	}
+
+	r->idiag_uid = from_kuid_munged(user_ns, sock_i_uid(hsk));
+	r->idiag_inode = sock_i_ino(hsk);
+}
+
+static int skip_diag_fill(struct sk_buff *skb, struct sock *sk,
+			  struct sock *hsk, struct net *net,
+			  struct user_namespace *user_ns,
+			  u32 portid, u32 seq, u32 flags)
+{
+	struct skip_sock *ssk = skip_sk(sk);
+	struct skip_diag_msg *rp;
+	struct skip_diag_addr va;
+	struct inet_diag_msg *r;
+	struct nlattr *attr;
+	struct nlmsghdr *nlh;
+
+	nlh = nlmsg_put(skb, portid, seq, SOCK_DIAG_BY_FAMILY,
+			sizeof(*rp), flags);
+	if (!nlh)
+		return -EMSGSIZE;
+
+	rp = nlmsg_data(nlh);
+	rp->sdiag_family = AF_SKIP;
+	rp->sdiag_type = sk->sk_type;
+	rp->sdiag_protocol = skip_diag_protocol(sk, hsk);
+	rp->sdiag_state = hsk ? hsk->sk_state : TCP_CLOSE;
+	rp->sdiag_ino = sock_i_ino(sk);
+	sock_diag_save_cookie(sk, rp->sdiag_cookie);
+
+	if (nla_put_s32(skb, SKIP_DIAG_NETNSID,
+			peernet2id(net, sock_net(sk))))
+		goto out_nlmsg_trim;
+
+	if (ssk->bound) {
+		struct sockaddr *sa = (struct sockaddr *)&ssk->vaddr;
+
+		memset(&va, 0, sizeof(va));
+		va.family = sa->sa_family;
+		if (sa->sa_family == AF_INET6)
+			memcpy(va.addr,
+			       &((struct sockaddr_in6 *)sa)->sin6_addr,
+			       sizeof(struct in6_addr));
+		else
+			va.addr[0] =
+				((struct sockaddr_in *)sa)->sin_addr.s_addr;
+
+		/* bind() with port 0. the host chose the port */
+		va.port = (sa->sa_family == AF_INET6) ?
+			((struct sockaddr_in6 *)sa)->sin6_port :
+			((struct sockaddr_in *)sa)->sin_port;
+		if (!va.port && hsk)
+			va.port = inet_sk(hsk)->inet_sport;
+
+		if (nla_put(skb, SKIP_DIAG_VADDR, sizeof(va), &va))
+			goto out_nlmsg_trim;
+	}
+
+	if (hsk) {
+		attr = nla_reserve(skb, SKIP_DIAG_HOST, sizeof(*r));
+		if (!attr)
+			goto out_nlmsg_trim;
+		r = nla_data(attr);
+		skip_diag_fill_host(hsk, r, user_ns);
+	}
+
+	if (ssk->any &&
+	    nla_put_u32(skb, SKIP_DIAG_FANIN, ssk->nfanin + 1))
+		goto out_nlmsg_trim;
+
+	nlmsg_end(skb, nlh);
+	return 0;
+
+out_nlmsg_trim:
+	nlmsg_cancel(skb, nlh);
+	return -EMSGSIZE;
+}
+
+static int skip_diag_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	int num, s_num, slot, s_slot;
+	struct net *net = sock_net(skb->sk);
+	struct user_namespace *user_ns = sk_user_ns(NETLINK_CB(cb->skb).sk);
+	struct skip_diag_req *req;
+	struct nlattr *bc = NULL;
+	struct skip_diag_bucket *b;
+	struct socket *hsock;
+	struct sock *sk, *hsk;
+
+	req = nlmsg_data(cb->nlh);
+	if (nlmsg_attrlen(cb->nlh, sizeof(*req)))
+		bc = nlmsg_find_attr(cb->nlh, sizeof(*req),
+				     SKIP_DIAG_REQ_BYTECODE);
+
+	s_slot = cb->args[0];
+	s_num = cb->args[1];
+
+	for (slot = s_slot; slot < SKIP_DIAG_HASH_SIZE; s_num = 0, slot++) {
+		b = &skip_diag_hash[slot];
+		num = 0;
+
+		spin_lock(&b->lock);
+		sk_for_each(sk, &b->head) {
+			/* the default netns sees skip sockets of all
+			 * namespaces, because their host sockets are
+			 * there. others see only their own. */
+			if (!net_eq(net, &init_net) &&
+			    !net_eq(sock_net(sk), net))
+				continue;
+			if (num < s_num)
+				goto next;
+
+			hsock = skip_hsock(skip_sk(sk));
+			hsk = hsock ? hsock->sk : NULL;
+
+			if (!(req->sdiag_states &
+			      (1 << (hsk ? hsk->sk_state : TCP_CLOSE))))
+				goto next;
+			if (req->sdiag_protocol &&
+			    req->sdiag_protocol != skip_diag_protocol(sk, hsk))
+				goto next;
+			if (bc && (!hsk || !inet_diag_bc_sk(bc, hsk)))
+				goto next;
+
+			if (skip_diag_fill(skb, sk, hsk, net, user_ns,
+					   NETLINK_CB(cb->skb).portid,
+					   cb->nlh->nlmsg_seq,
+					   NLM_F_MULTI) < 0) {
+				spin_unlock(&b->lock);
+				goto done;
+			}
+next:
+			num++;
+		}
+		spin_unlock(&b->lock);
+	}
+
+done:
+	cb->args[0] = slot;
+	cb->args[1] = num;
+
+	return skb->len;
+}
+
+static int skip_diag_handler_dump(struct sk_buff *skb, struct nlmsghdr *h)
+{
+	int hdrlen = sizeof(struct skip_diag_req);
+	struct net *net = sock_net(skb->sk);
+	struct nlattr *attr;
+	int err;
+
+	if (nlmsg_len(h) < hdrlen)
+		return -EINVAL;
+
+	if (!(h->nlmsg_flags & NLM_F_DUMP))
+		return -EOPNOTSUPP;
+
+	if (nlmsg_attrlen(h, hdrlen)) {
+		attr = nlmsg_find_attr(h, hdrlen, SKIP_DIAG_REQ_BYTECODE);
+		if (attr) {
+			err = skip_diag_bc_audit(attr, skb);
+			if (err)
+				return err;
+		}
+	}
+
+	{
+		struct netlink_dump_control c = {
+			.dump = skip_diag_dump,
+		};
+		return netlink_dump_start(net->diag_nlsk, skb, h, &c);
+	}
+}
+
+static const struct sock_diag_handler skip_diag_handler = {
+	.family	= AF_SKIP,
+	.dump	= skip_diag_handler_dump,
+};
+
+
+int skip_diag_init(void)
+{
+	int n;
+
+	for (n = 0; n < SKIP_DIAG_HASH_SIZE; n++) {
+		spin_lock_init(&skip_diag_hash[n].lock);
+		INIT_HLIST_HEAD(&skip_diag_hash[n].head);
+	}
+
+	return sock_diag_register(&skip_diag_handler);
+}
+
+void skip_diag_exit(void)
+{
+	sock_diag_unregister(&skip_diag_handler);
+}
+
+/* NETLINK_SOCK_DIAG requests for AF_SKIP load this module */
+MODULE_ALIAS_NET_PF_PROTO_TYPE(PF_NETLINK, NETLINK_SOCK_DIAG, AF_SKIP);
@@ -11,9 +11,17 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/skbuff.h>
+#include <linux/netdevice.h>
 #include <linux/socket.h>
 #include <linux/types.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/inetdevice.h>
 #include <net/ip.h>
+#include <net/ipv6.h>
+#include <net/netns/generic.h>
 #include <net/lwtunnel.h>
 #include <net/ip_fib.h>
 #include <net/ip6_fib.h>
@@ -30,19 +38,645 @@
 
 
 
+/* per-netns skip prefix table.
+ *
+ * skip states are indexed by (prefix, prefix length) in a hash table
+ * per address family. AF_SKIP sockets resolve the skip state of an
+ * address by probing the populated prefix lengths from the longest
+ * one, under rcu_read_lock() and without any FIB lookup or dst
+ * reference. Insertion and removal follow the lifetime of the
+ * lwtunnel state (skip_build_state/skip_destroy_state).
+ *
+ * The table sees skip routes only, of any table: the longest skip
+ * prefix wins regardless of FIB rules, the table the route is in,
+ * and more specific routes without skip encap.
+ */
 
-static int skip_input(struct sk_buff *skb)
+#define SKIP_TABLE_HASH_BITS	8
+#define SKIP_TABLE_HASH_SIZE	(1 << SKIP_TABLE_HASH_BITS)
+#define SKIP_TABLE_PLEN_MAX	128
+
+struct skip_table {
+	unsigned int		count[SKIP_TABLE_PLEN_MAX + 1]; /* per plen */
+	struct hlist_head	hash[SKIP_TABLE_HASH_SIZE];
+};
+
+struct skip_net {
+	struct skip_table	tbl4;
+	struct skip_table	tbl6;
+
+	/* a v4v6map route, for IPv4 sockets not bound through any
+	 * route (connect() and sendmsg() without bind()) */
+	struct skip_lwt __rcu	*map;
+
+	/* bumped by every insertion and removal. sockets revalidate
+	 * the route they resolved when it changes. */
+	atomic_t		gen;
+};
+
+static unsigned int skip_net_id __read_mostly;
+
+static bool reset_stale = false;
+module_param(reset_stale, bool, 0644);
+MODULE_PARM_DESC(reset_stale, "abort the host sockets of the sockets "
+		 "bound through a deleted skip route");
+
+/* serializes writers of all tables. skip_destroy_state() may be
+ * called from softirq after the netns is gone, so that it must not
+ * depend on the per-netns storage. */
+static DEFINE_SPINLOCK(skip_table_lock);
+
+/* interned host states of all routes (struct skip_host). Routes
+ * with the same host config share one copy of it, which saves the
+ * copy only: per-route state, above all the per-CPU counters of
+ * slwt->stats, dominates the memory of a route. The table and
+ * refcnt are under skip_host_lock. */
+#define SKIP_HOST_HASH_BITS	8
+
+static struct hlist_head skip_host_table[1 << SKIP_HOST_HASH_BITS];
+static DEFINE_SPINLOCK(skip_host_lock);
+
+static inline struct skip_net *skip_net(struct net *net)
+{
+	return net_generic(net, skip_net_id);
+}
+
+static inline u32 skip_table_hash4(__be32 addr, int plen)
+{
+	return jhash_2words((__force u32)addr, plen, 0) &
+		(SKIP_TABLE_HASH_SIZE - 1);
+}
+
+static inline u32 skip_table_hash6(const struct in6_addr *addr, int plen)
+{
+	return jhash2((const u32 *)addr, 4, plen) &
+		(SKIP_TABLE_HASH_SIZE - 1);
+}
+
+static void skip_table_insert(struct net *net, struct skip_lwt *slwt)
+{
+	u32 hash;
+	struct skip_table *tbl;
+	struct skip_net *snet = skip_net(net);
+
+	if (slwt->dst_family == AF_INET) {
+		tbl = &snet->tbl4;
+		hash = skip_table_hash4(slwt->dst_addr4, slwt->dst_len);
+	} else {
+		tbl = &snet->tbl6;
+		hash = skip_table_hash6(&slwt->dst_addr6, slwt->dst_len);
+	}
+
+	spin_lock_bh(&skip_table_lock);
+	slwt->net = net;
+	slwt->linked = true;
+	tbl->count[slwt->dst_len]++;
+	hlist_add_head_rcu(&slwt->hnode, &tbl->hash[hash]);
+	if (slwt->host->v4v6map)
+		rcu_assign_pointer(snet->map, slwt);
+	atomic_inc(&snet->gen);
+	spin_unlock_bh(&skip_table_lock);
+}
+
+static struct skip_lwt *skip_table_find_map(struct skip_table *tbl)
+{
+	int n;
+	struct skip_lwt *slwt;
+
+	for (n = 0; n < SKIP_TABLE_HASH_SIZE; n++) {
+		hlist_for_each_entry(slwt, &tbl->hash[n], hnode) {
+			if (slwt->host->v4v6map)
+				return slwt;
+		}
+	}
+
+	return NULL;
+}
+
+static void __skip_table_remove(struct skip_lwt *slwt)
+{
+	struct skip_net *snet = skip_net(slwt->net);
+	struct skip_table *tbl;
+
+	tbl = (slwt->dst_family == AF_INET) ? &snet->tbl4 : &snet->tbl6;
+	tbl->count[slwt->dst_len]--;
+	hlist_del_init_rcu(&slwt->hnode);
+	slwt->linked = false;
+
+	if (rcu_access_pointer(snet->map) == slwt)
+		rcu_assign_pointer(snet->map, skip_table_find_map(tbl));
+
+	atomic_inc(&snet->gen);
+}
+
+static void skip_table_remove(struct skip_lwt *slwt)
+{
+	spin_lock_bh(&skip_table_lock);
+	if (slwt->linked)
+		__skip_table_remove(slwt);
+	spin_unlock_bh(&skip_table_lock);
+}
+
+static struct skip_lwt *skip_table_lookup4(struct skip_table *tbl,
+					   __be32 addr)
+{
+	int plen;
+	__be32 prefix;
+	struct skip_lwt *slwt;
+
+	for (plen = 32; plen >= 0; plen--) {
+		if (!READ_ONCE(tbl->count[plen]))
+			continue;
+
+		prefix = addr & inet_make_mask(plen);
+		hlist_for_each_entry_rcu(slwt,
+					 &tbl->hash[skip_table_hash4(prefix,
+								     plen)],
+					 hnode) {
+			if (slwt->dst_len == plen &&
+			    slwt->dst_addr4 == prefix)
+				return slwt;
+		}
+	}
+
+	return NULL;
+}
+
+static struct skip_lwt *skip_table_lookup6(struct skip_table *tbl,
+					   const struct in6_addr *addr)
+{
+	int plen;
+	struct in6_addr prefix;
+	struct skip_lwt *slwt;
+
+	for (plen = 128; plen >= 0; plen--) {
+		if (!READ_ONCE(tbl->count[plen]))
+			continue;
+
+		ipv6_addr_prefix(&prefix, addr, plen);
+		hlist_for_each_entry_rcu(slwt,
+					 &tbl->hash[skip_table_hash6(&prefix,
+								     plen)],
+					 hnode) {
+			if (slwt->dst_len == plen &&
+			    ipv6_addr_equal(&slwt->dst_addr6, &prefix))
+				return slwt;
+		}
+	}
+
+	return NULL;
+}
+
+struct skip_lwt *skip_lwt_lookup(struct net *net, struct sockaddr *addr)
+{
+	struct skip_net *snet = skip_net(net);
+
+	switch (addr->sa_family) {
+	case AF_INET:
+		return skip_table_lookup4(&snet->tbl4,
+				((struct sockaddr_in *)addr)->sin_addr.s_addr);
+	case AF_INET6:
+		return skip_table_lookup6(&snet->tbl6,
+				&((struct sockaddr_in6 *)addr)->sin6_addr);
+	}
+
+	return NULL;
+}
+
+static bool skip_host_addr_listed(struct sockaddr_storage *addrs, int n,
+				  struct skip_lwt *slwt)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (addrs[i].ss_family != slwt->host->host_family)
+			continue;
+		if (slwt->host->host_family == AF_INET &&
+		    ((struct sockaddr_in *)&addrs[i])->sin_addr.s_addr ==
+		    slwt->host->host_addr4)
+			return true;
+		if (slwt->host->host_family == AF_INET6 &&
+		    ipv6_addr_equal(&((struct sockaddr_in6 *)
+				      &addrs[i])->sin6_addr,
+				    &slwt->host->host_addr6))
+			return true;
+	}
+
+	return false;
+}
+
+bool skip_lwt_map_prefix(struct net *net, struct in6_addr *prefix)
+{
+	/* map prefix of the v4v6map route of the netns, if any */
+
+	bool found = false;
+	struct skip_lwt *slwt;
+
+	rcu_read_lock();
+	slwt = rcu_dereference(skip_net(net)->map);
+	if (slwt) {
+		*prefix = slwt->host->map_prefix;
+		found = true;
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
+u32 skip_lwt_gen(struct net *net)
+{
+	return atomic_read(&skip_net(net)->gen);
+}
+
+static void skip_lwt_dst_addr(struct skip_lwt *slwt,
+			      struct sockaddr_storage *ss)
+{
+	/* the virtual address of a host route. zero family for a
+	 * prefix that has no single virtual address. */
+
+	memset(ss, 0, sizeof(*ss));
+	if (slwt->dst_family == AF_INET && slwt->dst_len == 32) {
+		ss->ss_family = AF_INET;
+		((struct sockaddr_in *)ss)->sin_addr.s_addr = slwt->dst_addr4;
+	} else if (slwt->dst_family == AF_INET6 && slwt->dst_len == 128) {
+		ss->ss_family = AF_INET6;
+		((struct sockaddr_in6 *)ss)->sin6_addr = slwt->dst_addr6;
+	}
+}
+
+int skip_lwt_host_addrs(struct net *net, int family,
+			struct skip_host_addrs *ha)
+{
+	/* collect distinct host addresses of all skip routes of the
+	 * family in the netns, for wildcard bind. addresses are
+	 * returned with port 0, with the virtual address of each
+	 * (see skip_lwt_dst_addr()). Host sockets of a socket live in
+	 * one netns, so that routes to other netns than that of the
+	 * first one found are skipped, and so are routes that do not
+	 * permit inbound. -ENOSPC if there are more than
+	 * SKIP_FANIN_MAX addresses. */
+
+	int n, ret = 0;
+	struct skip_lwt *slwt;
+	struct skip_table *tbl;
+	struct sockaddr_in *sa4;
+	struct sockaddr_in6 *sa6;
+	struct sockaddr_storage *addr;
+	struct net *hnet = NULL;
+	struct skip_net *snet = skip_net(net);
+
+	switch (family) {
+	case AF_INET:
+		tbl = &snet->tbl4;
+		break;
+	case AF_INET6:
+		tbl = &snet->tbl6;
+		break;
+	default:
+		return -EAFNOSUPPORT;
+	}
+
+	ha->count = 0;
+	ha->policy = 0;
+	ha->net = NULL;
+
+	rcu_read_lock();
+	for (n = 0; n < SKIP_TABLE_HASH_SIZE; n++) {
+		hlist_for_each_entry_rcu(slwt, &tbl->hash[n], hnode) {
+			if (!(slwt->host->policy & SKIP_POLICY_INBOUND))
+				continue;
+			if (hnet && !net_eq(hnet, skip_lwt_host_net(slwt)))
+				continue;
+			hnet = skip_lwt_host_net(slwt);
+			ha->policy |= slwt->host->policy;
+			if (skip_host_addr_listed(ha->addrs, ha->count, slwt))
+				continue;
+			if (ha->count >= SKIP_FANIN_MAX) {
+				pr_warn_ratelimited("wildcard bind over more "
+						    "than %d host addresses\n",
+						    SKIP_FANIN_MAX);
+				ret = -ENOSPC;
+				goto out;
+			}
+
+			addr = &ha->addrs[ha->count];
+			memset(addr, 0, sizeof(*addr));
+			if (slwt->host->host_family == AF_INET) {
+				sa4 = (struct sockaddr_in *)addr;
+				sa4->sin_family = AF_INET;
+				sa4->sin_addr.s_addr = slwt->host->host_addr4;
+			} else {
+				sa6 = (struct sockaddr_in6 *)addr;
+				sa6->sin6_family = AF_INET6;
+				sa6->sin6_addr = slwt->host->host_addr6;
+			}
+			skip_lwt_dst_addr(slwt, &ha->vaddrs[ha->count]);
+			ha->count++;
+		}
+	}
+out:
+	/* the route may be under destruction with its netns */
+	if (hnet && !(ha->net = maybe_get_net(hnet)))
+		ha->count = 0;
+	rcu_read_unlock();
+
+	return ret ? ret : ha->count;
+}
+
+static void skip_table_flush(struct skip_table *tbl)
+{
+	int n;
+	struct hlist_node *tmp;
+	struct skip_lwt *slwt;
+
+	for (n = 0; n < SKIP_TABLE_HASH_SIZE; n++) {
+		hlist_for_each_entry_safe(slwt, tmp, &tbl->hash[n], hnode)
+			__skip_table_remove(slwt);
+	}
+}
+
+static __net_init int skip_net_init(struct net *net)
 {
-	/* XXX: skip (currently) never enacp any packets */
+	/* net_generic storage is zeroed, tables are ready to use */
 	return 0;
 }
 
-static int skip_output(struct net *net, struct sock *sk, struct sk_buff *skb)
+static void __net_exit skip_net_exit(struct net *net)
+{
+	struct skip_net *snet = skip_net(net);
+
+	/* routes of this netns may be released after the per-netns
+	 * storage is freed. unlink them now. */
+	spin_lock_bh(&skip_table_lock);
+	RCU_INIT_POINTER(snet->map, NULL);
+	skip_table_flush(&snet->tbl4);
+	skip_table_flush(&snet->tbl6);
+	spin_unlock_bh(&skip_table_lock);
+}
+
+static struct pernet_operations skip_net_ops = {
+	.init	= skip_net_init,
+	.exit	= skip_net_exit,
+	.id	= &skip_net_id,
+	.size	= sizeof(struct skip_net),
+};
+
+
+
+static struct skip_stats *skip_stats_alloc(void)
 {
-	/* XXX: skip (currently) never enacp any packets */
+	int cpu;
+	struct skip_stats *stats;
+
+	stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return NULL;
+
+	stats->pcpu = alloc_percpu(struct skip_pcpu_stats);
+	if (!stats->pcpu) {
+		kfree(stats);
+		return NULL;
+	}
+
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&per_cpu_ptr(stats->pcpu, cpu)->syncp);
+
+	atomic_set(&stats->refcnt, 1);
+
+	return stats;
+}
+
+static void skip_stats_free_rcu(struct rcu_head *head)
+{
+	struct skip_stats *stats = container_of(head, struct skip_stats, rcu);
+
+	free_percpu(stats->pcpu);
+	kfree(stats);
+}
+
+struct skip_stats *skip_lwt_stats_get(struct skip_lwt *slwt)
+{
+	struct skip_stats *stats = slwt->stats;
+
+	/* the route may be under destruction */
+	if (!stats || !atomic_inc_not_zero(&stats->refcnt))
+		return NULL;
+
+	return stats;
+}
+
+void skip_stats_put(struct skip_stats *stats)
+{
+	if (stats && atomic_dec_and_test(&stats->refcnt))
+		call_rcu(&stats->rcu, skip_stats_free_rcu);
+}
+
+static int skip_addr_list_parse(struct skip_host *sh, struct nlattr *nla)
+{
+	/* SKIP_ATTR_HOST_ADDR_LIST: the pool of host source addresses.
+	 * The first one is the host address of the route. */
+
+	int rem, n = 0, type, len;
+	struct nlattr *attr;
+	struct skip_addr_list *list;
+
+	if (sh->host_family == AF_INET) {
+		type = SKIP_ATTR_HOST_ADDR4;
+		len = sizeof(__be32);
+	} else {
+		type = SKIP_ATTR_HOST_ADDR6;
+		len = sizeof(struct in6_addr);
+	}
+
+	nla_for_each_nested(attr, nla, rem) {
+		if (nla_type(attr) != type || nla_len(attr) != len) {
+			pr_err("invalid host address in the list\n");
+			return -EINVAL;
+		}
+		n++;
+	}
+
+	if (n == 0 || n > SKIP_HOST_ADDR_LIST_MAX) {
+		pr_err("host address list of %d addresses\n", n);
+		return -EINVAL;
+	}
+
+	list = kzalloc(sizeof(*list) + n * sizeof(list->addr[0]),
+		       GFP_KERNEL);
+	if (!list)
+		return -ENOMEM;
+
+	atomic_set(&list->refcnt, 1);
+	list->family = sh->host_family;
+
+	nla_for_each_nested(attr, nla, rem)
+		nla_memcpy(&list->addr[list->count++], attr, len);
+
+	if (sh->host_family == AF_INET)
+		sh->host_addr4 = list->addr[0].a4;
+	else
+		sh->host_addr6 = list->addr[0].a6;
+
+	/* a single address is the same as no list */
+	if (list->count == 1) {
+		kfree(list);
+		return 0;
+	}
+
+	sh->addr_list = list;
+
 	return 0;
 }
 
+struct skip_addr_list *skip_lwt_addr_list_get(struct skip_lwt *slwt)
+{
+	struct skip_addr_list *list = slwt->host->addr_list;
+
+	if (!list || !atomic_inc_not_zero(&list->refcnt))
+		return NULL;
+
+	return list;
+}
+
+void skip_addr_list_put(struct skip_addr_list *list)
+{
+	if (list && atomic_dec_and_test(&list->refcnt))
+		kfree_rcu(list, rcu);
+}
+
+static bool skip_addr_list_equal(struct skip_addr_list *a,
+				 struct skip_addr_list *b)
+{
+	if (!a || !b)
+		return a == b;
+
+	return a->count == b->count &&
+		memcmp(a->addr, b->addr, a->count * sizeof(a->addr[0])) == 0;
+}
+
+static void skip_stats_sum(struct skip_stats *stats,
+			   struct skip_pcpu_stats *sum)
+{
+	int cpu;
+	unsigned int start;
+	struct skip_pcpu_stats *s, tmp;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		s = per_cpu_ptr(stats->pcpu, cpu);
+		do {
+			start = u64_stats_fetch_begin(&s->syncp);
+			tmp = *s;
+		} while (u64_stats_fetch_retry(&s->syncp, start));
+
+		sum->bind += tmp.bind;
+		sum->connect += tmp.connect;
+		sum->accept += tmp.accept;
+		sum->tx_packets += tmp.tx_packets;
+		sum->tx_bytes += tmp.tx_bytes;
+		sum->rx_packets += tmp.rx_packets;
+		sum->rx_bytes += tmp.rx_bytes;
+		sum->lookup_fail += tmp.lookup_fail;
+		sum->reject_inbound += tmp.reject_inbound;
+		sum->reject_outbound += tmp.reject_outbound;
+		sum->pkt_output += tmp.pkt_output;
+		sum->pkt_input += tmp.pkt_input;
+		sum->pkt_drop += tmp.pkt_drop;
+	}
+}
+
+
+
+static bool skip_redirect_ttl(struct sk_buff *skb, int family)
+{
+	/* redirected forwarded packets are routed again in the host
+	 * netns. routes redirecting to each other would loop them
+	 * forever without this.
+	 * XXX: no ICMP time exceeded is sent. */
+
+	if (skb_cow(skb, 0))
+		return false;
+
+	if (family == AF_INET) {
+		if (ip_hdr(skb)->ttl <= 1)
+			return false;
+		ip_decrease_ttl(ip_hdr(skb));
+	} else {
+		if (ipv6_hdr(skb)->hop_limit <= 1)
+			return false;
+		ipv6_hdr(skb)->hop_limit--;
+	}
+
+	return true;
+}
+
+static int skip_redirect(struct sk_buff *skb, bool input)
+{
+	/* packet mode: hand the skb matched by a skip route over to
+	 * the stack of the host netns, as if it was received on the
+	 * loopback device there. Neither a veth pair nor the
+	 * FORWARD/POSTROUTING hooks of the netns of the route are
+	 * traversed. Addresses are not translated, the host netns
+	 * routes the packet by its destination address. */
+
+	int ret;
+	struct skip_lwt *slwt;
+	struct skip_stats *stats;
+	struct net_device *dev;
+
+	rcu_read_lock();
+
+	slwt = skip_lwt_lwtunnel(skb_dst(skb)->lwtstate);
+	stats = slwt->stats;
+	dev = skip_lwt_host_net(slwt)->loopback_dev;
+
+	if (unlikely(!(dev->flags & IFF_UP)) ||
+	    (input && !skip_redirect_ttl(skb, slwt->dst_family))) {
+		skip_stats_inc(stats, pkt_drop);
+		rcu_read_unlock();
+		kfree_skb(skb);
+		return -ENETDOWN;
+	}
+
+	if (input)
+		skip_stats_inc(stats, pkt_input);
+	else
+		skip_stats_inc(stats, pkt_output);
+
+	/* drops the dst, and the socket of local packets */
+	skb_scrub_packet(skb, true);
+
+	skb->dev = dev;
+	skb->protocol = (slwt->dst_family == AF_INET) ?
+		htons(ETH_P_IP) : htons(ETH_P_IPV6);
+	skb->pkt_type = PACKET_HOST;
+	skb_reset_mac_header(skb);
+
+	/* .output runs in process context with BHs enabled, and
+	 * netif_rx() there leaves the softirq pending */
+	if (input)
+		ret = netif_rx(skb);
+	else
+		ret = netif_rx_ni(skb);
+	if (ret != NET_RX_SUCCESS)
+		skip_stats_inc(stats, pkt_drop);
+
+	rcu_read_unlock();
+
+	return ret == NET_RX_SUCCESS ? 0 : -ENOBUFS;
+}
+
+static int skip_input(struct sk_buff *skb)
+{
+	return skip_redirect(skb, true);
+}
+
+static int skip_output(struct net *net, struct sock *sk, struct sk_buff *skb)
+{
+	return skip_redirect(skb, false);
+}
+
 static const struct nla_policy skip_nl_policy[SKIP_ATTR_MAX + 1] = {
 	[SKIP_ATTR_HOST_ADDR4]	= { .type = NLA_U32 },
 	[SKIP_ATTR_HOST_ADDR6]	= { .type = NLA_BINARY,
@@ -53,8 +687,129 @@ static const struct nla_policy skip_nl_policy[SKIP_ATTR_MAX + 1] = {
 	[SKIP_ATTR_MAP_V4V6]	= { .type = NLA_U8 },
 	[SKIP_ATTR_MAP_PREFIX]	= { .type = NLA_BINARY,
 				    .len = sizeof(struct in6_addr) },
+	[SKIP_ATTR_HANDOFF]	= { .type = NLA_U8 },
+	[SKIP_ATTR_PACKET]	= { .type = NLA_U8 },
+	[SKIP_ATTR_HOST_ADDR_LIST] = { .type = NLA_NESTED },
+	[SKIP_ATTR_NETNS_ID]	= { .type = NLA_S32 },
+	[SKIP_ATTR_NETNS_FD]	= { .type = NLA_U32 },
 };
 
+static int skip_host_net_parse(struct skip_host *sh, struct net *net,
+			       struct nlattr **tb)
+{
+	/* netns of the host sockets, by nsid seen from the netns of
+	 * the route, or by fd. The reference is kept while the route
+	 * exists, so that creating host sockets never resolves it. */
+
+	struct net *hnet;
+
+	if (tb[SKIP_ATTR_NETNS_FD])
+		hnet = get_net_ns_by_fd(nla_get_u32(tb[SKIP_ATTR_NETNS_FD]));
+	else if (tb[SKIP_ATTR_NETNS_ID])
+		hnet = get_net_ns_by_id(net,
+					nla_get_s32(tb[SKIP_ATTR_NETNS_ID]));
+	else
+		return 0;	/* init_net */
+
+	if (IS_ERR_OR_NULL(hnet)) {
+		pr_err("netns of host sockets not found\n");
+		return hnet ? PTR_ERR(hnet) : -EINVAL;
+	}
+
+	/* XXX: a route referring to its own netns keeps the netns
+	 * alive forever. */
+	if (net_eq(hnet, net)) {
+		pr_err("netns of host sockets is that of the route\n");
+		put_net(hnet);
+		return -EINVAL;
+	}
+
+	if (net_eq(hnet, &init_net)) {
+		put_net(hnet);
+		return 0;
+	}
+
+	/* make the nsid seen in the dump */
+	peernet2id_alloc(net, hnet);
+	sh->host_net = hnet;
+
+	return 0;
+}
+
+static u32 skip_host_hashfn(struct skip_host *sh)
+{
+	return jhash_3words((__force u32)sh->host_addr4,
+			    ipv6_addr_hash(&sh->host_addr6),
+			    hash_ptr(sh->net, 32) ^ hash_ptr(sh->host_net, 32),
+			    sh->host_family);
+}
+
+static bool skip_host_equal(struct skip_host *a, struct skip_host *b)
+{
+	return a->net == b->net &&
+		a->host_family == b->host_family &&
+		a->host_addr4 == b->host_addr4 &&
+		ipv6_addr_equal(&a->host_addr6, &b->host_addr6) &&
+		a->inbound == b->inbound &&
+		a->outbound == b->outbound &&
+		a->v4v6map == b->v4v6map &&
+		ipv6_addr_equal(&a->map_prefix, &b->map_prefix) &&
+		a->handoff == b->handoff &&
+		a->packet == b->packet &&
+		a->host_net == b->host_net &&
+		skip_addr_list_equal(a->addr_list, b->addr_list);
+}
+
+static void skip_host_free(struct skip_host *sh)
+{
+	skip_addr_list_put(sh->addr_list);
+	if (sh->host_net)
+		put_net(sh->host_net);
+	kfree_rcu(sh, rcu);
+}
+
+static struct skip_host *skip_host_intern(struct skip_host *new)
+{
+	/* return the host state equal to new with a reference, and
+	 * free new. Or, new is inserted. */
+
+	struct skip_host *sh;
+	struct hlist_head *head;
+
+	new->hash = skip_host_hashfn(new);
+	head = &skip_host_table[hash_32(new->hash, SKIP_HOST_HASH_BITS)];
+
+	spin_lock_bh(&skip_host_lock);
+	hlist_for_each_entry(sh, head, hnode) {
+		if (sh->hash == new->hash && skip_host_equal(sh, new)) {
+			sh->refcnt++;
+			spin_unlock_bh(&skip_host_lock);
+			skip_host_free(new);
+			return sh;
+		}
+	}
+	new->refcnt = 1;
+	hlist_add_head(&new->hnode, head);
+	spin_unlock_bh(&skip_host_lock);
+
+	return new;
+}
+
+static void skip_host_put(struct skip_host *sh)
+{
+	spin_lock_bh(&skip_host_lock);
+	if (--sh->refcnt) {
+		spin_unlock_bh(&skip_host_lock);
+		return;
+	}
+	hlist_del(&sh->hnode);
+	spin_unlock_bh(&skip_host_lock);
+
+	/* readers of the prefix table may still see it through
+	 * slwt->host, so that it is freed after a grace period */
+	skip_host_free(sh);
+}
+
 static void skip_pr_state(struct skip_lwt *slwt)
 {
 	switch(slwt->dst_family){
@@ -68,21 +823,26 @@ static void skip_pr_state(struct skip_lwt *slwt)
 		break;
 	}
 
-	switch(slwt->host_family){
+	switch(slwt->host->host_family){
 	case AF_INET:
 		pr_debug("lwt: host: family AF_INET, %pI4\n",
-			&slwt->host_addr4);
+			&slwt->host->host_addr4);
 		break;
 	case AF_INET6:
 		pr_debug("lwt: host: family AF_INET6, %pI6\n",
-			&slwt->host_addr6);
+			&slwt->host->host_addr6);
 		break;
 	}
 
 	pr_debug("lwt: inoubnd %d, outbound %d\n",
-		slwt->inbound, slwt->outbound);
+		slwt->host->inbound, slwt->host->outbound);
 	pr_debug("lwt: v4v6map %d, map_prefix %pI6\n",
-		slwt->v4v6map, &slwt->map_prefix);
+		slwt->host->v4v6map, &slwt->host->map_prefix);
+	pr_debug("lwt: handoff %d\n", slwt->host->handoff);
+	pr_debug("lwt: packet %d\n", slwt->host->packet);
+	pr_debug("lwt: host address pool %d\n",
+		 slwt->host->addr_list ? slwt->host->addr_list->count : 1);
+	pr_debug("lwt: host netns %p\n", skip_lwt_host_net(slwt));
 }
 
 static int skip_build_state(struct net_device * dev, struct nlattr *nla,
@@ -90,7 +850,9 @@ static int skip_build_state(struct net_device * dev, struct nlattr *nla,
 			    struct lwtunnel_state **ts)
 {
 	int ret;
+	struct net *net = NULL;
 	struct skip_lwt *slwt;
+	struct skip_host *sh;
 	struct nlattr *tb[SKIP_ATTR_MAX + 1];
 	struct lwtunnel_state *newts;
 	const struct fib_config *cfg4 = cfg;
@@ -110,110 +872,316 @@ static int skip_build_state(struct net_device * dev, struct nlattr *nla,
 
 	slwt = skip_lwt_lwtunnel(newts);
 	memset(slwt, 0, sizeof(*slwt));
+	INIT_HLIST_NODE(&slwt->hnode);
+
+	sh = kzalloc(sizeof(*sh), GFP_KERNEL);
+	if (!sh) {
+		kfree(newts);
+		return -ENOMEM;
+	}
+	slwt->host = sh;
 
 	slwt->dst_family = family;
-	if (family == AF_INET)
-		slwt->dst_addr4 = cfg4->fc_dst;
-	else if (family == AF_INET6)
-		slwt->dst_addr6 = cfg6->fc_dst;
-	else {
+	if (family == AF_INET) {
+		net = cfg4->fc_nlinfo.nl_net;
+		slwt->dst_len = cfg4->fc_dst_len;
+		slwt->dst_addr4 = cfg4->fc_dst &
+			inet_make_mask(slwt->dst_len);
+	} else if (family == AF_INET6) {
+		net = cfg6->fc_nlinfo.nl_net;
+		slwt->dst_len = cfg6->fc_dst_len;
+		ipv6_addr_prefix(&slwt->dst_addr6, &cfg6->fc_dst,
+				 slwt->dst_len);
+	} else {
 		pr_err("invalid family of route '%u'", family);
 		goto err_out;
 	}
+	sh->net = net;
 
 	/* parse and setup host address acquisition */
 	if (!tb[SKIP_ATTR_HOST_ADDR_FAMILY]) {
 		pr_err("SKIP_ATTR_HOST_ADDR_FAMILY does not exist\n");
 		goto err_out;
 	}
-	slwt->host_family = nla_get_u32(tb[SKIP_ATTR_HOST_ADDR_FAMILY]);
+	sh->host_family = nla_get_u32(tb[SKIP_ATTR_HOST_ADDR_FAMILY]);
 
-	if (slwt->host_family == AF_INET)
-		slwt->host_addr4 = nla_get_be32(tb[SKIP_ATTR_HOST_ADDR4]);
-	else if (slwt->host_family == AF_INET6)
-		nla_memcpy(&slwt->host_addr6, tb[SKIP_ATTR_HOST_ADDR6],
-			   sizeof(struct in6_addr));
-	else {
+	if (sh->host_family != AF_INET && sh->host_family != AF_INET6) {
 		pr_err("invalid family of host address '%u'\n",
-		       slwt->host_family);
+		       sh->host_family);
 		goto err_out;
 	}
+
+	if (tb[SKIP_ATTR_HOST_ADDR_LIST]) {
+		ret = skip_addr_list_parse(sh, tb[SKIP_ATTR_HOST_ADDR_LIST]);
+		if (ret)
+			goto err_out;
+		ret = -EINVAL;
+	} else if (sh->host_family == AF_INET)
+		sh->host_addr4 = nla_get_be32(tb[SKIP_ATTR_HOST_ADDR4]);
+	else
+		nla_memcpy(&sh->host_addr6, tb[SKIP_ATTR_HOST_ADDR6],
+			   sizeof(struct in6_addr));
 			
 	/* setup inbound/outbound configurations */
 	if (tb[SKIP_ATTR_INBOUND] && nla_get_u8(tb[SKIP_ATTR_INBOUND]))
-		slwt->inbound = true;
+		sh->inbound = true;
 	if (tb[SKIP_ATTR_OUTBOUND] && nla_get_u8(tb[SKIP_ATTR_OUTBOUND]))
-		slwt->outbound = true;
+		sh->outbound = true;
+
+	if (sh->inbound)
+		sh->policy |= SKIP_POLICY_INBOUND;
+	if (sh->outbound)
+		sh->policy |= SKIP_POLICY_OUTBOUND;
+	if (!sh->policy)
+		sh->policy = SKIP_POLICY_ANY;
 
 	/* setup v4/v6 mapping configurations */
 	if (tb[SKIP_ATTR_MAP_V4V6] && tb[SKIP_ATTR_MAP_PREFIX] &&
 	    nla_get_u8(tb[SKIP_ATTR_MAP_V4V6])) {
-		slwt->v4v6map = true;
-		nla_memcpy(&slwt->map_prefix, tb[SKIP_ATTR_MAP_PREFIX],
+		sh->v4v6map = true;
+		nla_memcpy(&sh->map_prefix, tb[SKIP_ATTR_MAP_PREFIX],
 			   sizeof(struct in6_addr));
+
+		/* IPv4 addresses are embedded in the low 32 bits of
+		 * the prefix on IPv6 host sockets */
+		if (family != AF_INET || sh->host_family != AF_INET6) {
+			pr_err("v4v6map needs IPv4 route and IPv6 host\n");
+			goto err_out;
+		}
+	}
+
+	/* setup socket handoff */
+	if (tb[SKIP_ATTR_HANDOFF] && nla_get_u8(tb[SKIP_ATTR_HANDOFF]))
+		sh->handoff = true;
+
+	/* setup netns of host sockets */
+	ret = skip_host_net_parse(sh, net, tb);
+	if (ret)
+		goto err_out;
+	ret = -EINVAL;
+
+	/* setup packet mode */
+	if (tb[SKIP_ATTR_PACKET] && nla_get_u8(tb[SKIP_ATTR_PACKET]))
+		sh->packet = true;
+
+	if (sh->packet && net_eq(sh->host_net ? sh->host_net : &init_net,
+				 net)) {
+		pr_err("packet mode needs netns of host sockets\n");
+		goto err_out;
+	}
+
+	slwt->stats = skip_stats_alloc();
+	if (!slwt->stats) {
+		ret = -ENOMEM;
+		goto err_out;
 	}
 
-	
+	/* share the host state with the routes configured the same */
+	slwt->host = skip_host_intern(sh);
+	sh = NULL;	/* interned or freed */
+
 	newts->type = LWTUNNEL_ENCAP_SKIP;
-        newts->flags |= LWTUNNEL_STATE_OUTPUT_REDIRECT |
-                        LWTUNNEL_STATE_INPUT_REDIRECT;
-
-	/* XXX:
-	 * current skip does not have any functionalities for actual
-	 * output and input, so that it does not add
-	 * LWTUNNEL_STATE_OUTPUT_REDIREXCT and INPUT_REDIRECT. skip is
-	 * a routing entry for socket offloading.
-	 */
-	
+
+	/* skip is a routing entry for socket offloading. Packets
+	 * take the route as usual unless packet mode is enabled. */
+	if (slwt->host->packet)
+		newts->flags |= LWTUNNEL_STATE_OUTPUT_REDIRECT |
+			LWTUNNEL_STATE_INPUT_REDIRECT;
+
 	*ts = newts;
 
+	skip_table_insert(net, slwt);
 	skip_pr_state(slwt);
 
 	return 0;
 
 err_out:
+	if (sh)
+		skip_host_free(sh);
+	skip_stats_put(slwt->stats);
 	kfree(newts);
 	*ts = NULL;
 	return ret;
 }
 
+struct skip_reset_work {
+	struct work_struct	work;
+	struct skip_stats	*stats;
+};
+
+static void skip_reset_work_fn(struct work_struct *work)
+{
+	struct skip_reset_work *rw =
+		container_of(work, struct skip_reset_work, work);
+
+	skip_diag_reset(rw->stats);
+	skip_stats_put(rw->stats);
+	kfree(rw);
+}
+
+static void skip_reset_schedule(struct skip_lwt *slwt)
+{
+	/* the sockets bound through a route hold its counters.
+	 * destroy_state may be in softirq, and aborting sockets
+	 * needs process context. */
+
+	struct skip_reset_work *rw;
+
+	rw = kmalloc(sizeof(*rw), GFP_ATOMIC);
+	if (!rw)
+		return;
+
+	atomic_inc(&slwt->stats->refcnt);
+	rw->stats = slwt->stats;
+	INIT_WORK(&rw->work, skip_reset_work_fn);
+	schedule_work(&rw->work);
+}
+
 static void skip_destroy_state(struct lwtunnel_state *lwt)
 {
+	struct skip_lwt *slwt = skip_lwt_lwtunnel(lwt);
+
 	pr_debug("%s\n", __func__);
+
+	/* lwtstate is freed by kfree_rcu() after this, so that
+	 * lockless readers of the prefix table are safe. */
+	skip_table_remove(slwt);
+
+	/* after the removal, the sockets of this route find their
+	 * route gone (see skip_sock_reset()) */
+	if (READ_ONCE(reset_stale))
+		skip_reset_schedule(slwt);
+
+	skip_stats_put(slwt->stats);
+	skip_host_put(slwt->host);
+}
+
+static int skip_fill_stats(struct sk_buff *skb, struct skip_stats *stats)
+{
+	struct nlattr *nest;
+	struct skip_pcpu_stats sum;
+
+	skip_stats_sum(stats, &sum);
+
+	nest = nla_nest_start(skb, SKIP_ATTR_STATS);
+	if (!nest)
+		return -EMSGSIZE;
+
+	if (nla_put_u64_64bit(skb, SKIP_STATS_BIND, sum.bind,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_CONNECT, sum.connect,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_ACCEPT, sum.accept,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_TX_PACKETS, sum.tx_packets,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_TX_BYTES, sum.tx_bytes,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_RX_PACKETS, sum.rx_packets,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_RX_BYTES, sum.rx_bytes,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_LOOKUP_FAIL, sum.lookup_fail,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_REJECT_INBOUND,
+			      sum.reject_inbound, SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_REJECT_OUTBOUND,
+			      sum.reject_outbound, SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_PKT_OUTPUT, sum.pkt_output,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_PKT_INPUT, sum.pkt_input,
+			      SKIP_STATS_PAD) ||
+	    nla_put_u64_64bit(skb, SKIP_STATS_PKT_DROP, sum.pkt_drop,
+			      SKIP_STATS_PAD)) {
+		nla_nest_cancel(skb, nest);
+		return -EMSGSIZE;
+	}
+
+	nla_nest_end(skb, nest);
+
+	return 0;
+}
+
+static int skip_fill_addr_list(struct sk_buff *skb,
+			       struct skip_addr_list *list)
+{
+	int n;
+	struct nlattr *nest;
+
+	nest = nla_nest_start(skb, SKIP_ATTR_HOST_ADDR_LIST);
+	if (!nest)
+		return -EMSGSIZE;
+
+	for (n = 0; n < list->count; n++) {
+		if ((list->family == AF_INET &&
+		     nla_put_be32(skb, SKIP_ATTR_HOST_ADDR4,
+				  list->addr[n].a4)) ||
+		    (list->family == AF_INET6 &&
+		     nla_put(skb, SKIP_ATTR_HOST_ADDR6,
+			     sizeof(struct in6_addr), &list->addr[n].a6))) {
+			nla_nest_cancel(skb, nest);
+			return -EMSGSIZE;
+		}
+	}
+
+	nla_nest_end(skb, nest);
+
+	return 0;
 }
 
 static int skip_fill_encap_info(struct sk_buff *skb,
 				struct lwtunnel_state *lwtstate)
 {
 	struct skip_lwt *slwt = skip_lwt_lwtunnel(lwtstate);
+	struct skip_host *sh = slwt->host;
 
-	if (nla_put_u32(skb, SKIP_ATTR_HOST_ADDR_FAMILY, slwt->host_family))
+	if (nla_put_u32(skb, SKIP_ATTR_HOST_ADDR_FAMILY, sh->host_family))
 		goto nla_put_failure;
 
-	if (slwt->host_family == AF_INET) {
-		if (nla_put_be32(skb, SKIP_ATTR_HOST_ADDR4, slwt->host_addr4))
+	if (sh->host_family == AF_INET) {
+		if (nla_put_be32(skb, SKIP_ATTR_HOST_ADDR4, sh->host_addr4))
 			goto nla_put_failure;
-	} else if (slwt->host_family == AF_INET6) {
+	} else if (sh->host_family == AF_INET6) {
 		if (nla_put(skb, SKIP_ATTR_HOST_ADDR6, sizeof(struct in6_addr),
-			    &slwt->host_addr6))
+			    &sh->host_addr6))
 			goto nla_put_failure;
 	}
 
-	if (nla_put_u8(skb, SKIP_ATTR_INBOUND, slwt->inbound ? 1 : 0))
+	if (nla_put_u8(skb, SKIP_ATTR_INBOUND, sh->inbound ? 1 : 0))
 		goto nla_put_failure;
 
-	if (nla_put_u8(skb, SKIP_ATTR_OUTBOUND, slwt->outbound ? 1 : 0))
+	if (nla_put_u8(skb, SKIP_ATTR_OUTBOUND, sh->outbound ? 1 : 0))
 		goto nla_put_failure;
 
-	if (nla_put_u8(skb, SKIP_ATTR_MAP_V4V6, slwt->v4v6map ? 1: 0))
+	if (nla_put_u8(skb, SKIP_ATTR_MAP_V4V6, sh->v4v6map ? 1: 0))
 		goto nla_put_failure;
 
-	if (slwt->v4v6map) {
+	if (sh->v4v6map) {
 		if (nla_put(skb, SKIP_ATTR_MAP_PREFIX, sizeof(struct in6_addr),
-			    &slwt->map_prefix))
+			    &sh->map_prefix))
 			goto nla_put_failure;
 	}
 
+	if (nla_put_u8(skb, SKIP_ATTR_HANDOFF, sh->handoff ? 1 : 0))
+		goto nla_put_failure;
+
+	if (nla_put_u8(skb, SKIP_ATTR_PACKET, sh->packet ? 1 : 0))
+		goto nla_put_failure;
+
+	if (sh->addr_list && skip_fill_addr_list(skb, sh->addr_list))
+		goto nla_put_failure;
+
+	if (sh->host_net &&
+	    nla_put_s32(skb, SKIP_ATTR_NETNS_ID,
+			peernet2id(slwt->net, sh->host_net)))
+		goto nla_put_failure;
+
+	if (nla_put_u32(skb, SKIP_ATTR_SHARED, READ_ONCE(sh->refcnt)))
+		goto nla_put_failure;
+
+	if (slwt->stats && skip_fill_stats(skb, slwt->stats))
+		goto nla_put_failure;
+
 	return 0;
 
 nla_put_failure:
@@ -224,22 +1192,42 @@ static int skip_encap_nlsize(struct lwtunnel_state *lwtstate)
 {
 	int nlsize = 0;
 	struct skip_lwt *slwt = skip_lwt_lwtunnel(lwtstate);
+	struct skip_host *sh = slwt->host;
 
 	nlsize += nla_total_size(sizeof(u32)) +	/* HOST_ADDR_FAMILY */
 		nla_total_size(sizeof(u8)) +	/* INBOUND */
 		nla_total_size(sizeof(u8)) +	/* OUTBOUND */
-		nla_total_size(sizeof(u8));	/* V4V6MAP */
+		nla_total_size(sizeof(u8)) +	/* V4V6MAP */
+		nla_total_size(sizeof(u8)) +	/* HANDOFF */
+		nla_total_size(sizeof(u8));	/* PACKET */
 
 	/* HOST_ADDR4 or ADDR6 */
-	if (slwt->host_family == AF_INET)
+	if (sh->host_family == AF_INET)
 		nlsize += nla_total_size(sizeof(u32));
-	else if (slwt->host_family == AF_INET6)
+	else if (sh->host_family == AF_INET6)
 		nlsize += nla_total_size_64bit(sizeof(struct in6_addr));
 
 	/* V4V6 Map Prefix */
-	if (slwt->v4v6map)
+	if (sh->v4v6map)
 		nlsize += nla_total_size_64bit(sizeof(struct in6_addr));
 
+	/* HOST_ADDR_LIST */
+	if (sh->addr_list)
+		nlsize += nla_total_size(0) + sh->addr_list->count *
+			nla_total_size(sizeof(struct in6_addr));
+
+	/* NETNS_ID */
+	if (sh->host_net)
+		nlsize += nla_total_size(sizeof(s32));
+
+	/* SHARED */
+	nlsize += nla_total_size(sizeof(u32));
+
+	/* STATS */
+	if (slwt->stats)
+		nlsize += nla_total_size(0) +
+			SKIP_STATS_MAX * nla_total_size_64bit(sizeof(u64));
+
 	return nlsize;
 }
 
@@ -248,12 +1236,16 @@ static int skip_encap_cmp(struct lwtunnel_state *a, struct lwtunnel_state *b)
 	struct skip_lwt *sa = skip_lwt_lwtunnel(a);
 	struct skip_lwt *sb = skip_lwt_lwtunnel(b);
 
-	if (sa->dst_addr4 == sb->dst_addr4 &&
+	/* host states are interned. The prefix length counts: IPv4
+	 * fib_info sharing merges the routes whose encap compares
+	 * equal, and 10.0.0.0/24 and 10.0.0.0/16 are two entries of
+	 * the prefix table. */
+	if (sa->dst_family == sb->dst_family &&
+	    sa->dst_len == sb->dst_len &&
+	    sa->dst_addr4 == sb->dst_addr4 &&
 	    memcmp(&sa->dst_addr6, &sb->dst_addr6,
 		   sizeof(struct in6_addr)) == 0 &&
-	    sa->host_addr4 == sb->host_addr4 &&
-	    memcmp(&sa->host_addr6, &sb->host_addr6,
-		   sizeof(struct in6_addr)) == 0)
+	    sa->host == sb->host)
 		return 0;
 
 	return 1;
@@ -273,10 +1265,28 @@ static const struct lwtunnel_encap_ops skip_encap_ops = {
 
 int skip_lwt_init(void)
 {
-	return lwtunnel_encap_add_ops(&skip_encap_ops, LWTUNNEL_ENCAP_SKIP);
+	int ret;
+
+	ret = register_pernet_subsys(&skip_net_ops);
+	if (ret) {
+		pr_err("%s: register_pernet_subsys failed '%d'\n",
+		       __func__, ret);
+		return ret;
+	}
+
+	ret = lwtunnel_encap_add_ops(&skip_encap_ops, LWTUNNEL_ENCAP_SKIP);
+	if (ret) {
+		pr_err("%s: lwtunnel_encap_add_ops failed '%d'\n",
+		       __func__, ret);
+		unregister_pernet_subsys(&skip_net_ops);
+	}
+
+	return ret;
 }
 
 void skip_lwt_exit(void)
 {
 	lwtunnel_encap_del_ops(&skip_encap_ops, LWTUNNEL_ENCAP_SKIP);
+	unregister_pernet_subsys(&skip_net_ops);
+	flush_scheduled_work();	/* skip_reset_work */
 }
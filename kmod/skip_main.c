@@ -11,7 +11,19 @@ static int __init skip_init(void)
 	ret = skip_lwt_init();
 	if (ret)
 		return ret;
-	
+
+	ret = skip_pool_init();
+	if (ret) {
+		pr_err("failed to init host socket pool '%d'\n", ret);
+		goto skip_pool_failed;
+	}
+
+	ret = skip_diag_init();
+	if (ret) {
+		pr_err("failed to init sock_diag '%d'\n", ret);
+		goto skip_diag_failed;
+	}
+
 	ret = af_skip_init();
 	if (ret) {
 		pr_err("failed to init AF_SKIP '%d'\n", ret);
@@ -23,14 +35,20 @@ static int __init skip_init(void)
 	return 0;
 
 af_skip_failed:
+	skip_diag_exit();
+skip_diag_failed:
+	skip_pool_exit();
+skip_pool_failed:
 	skip_lwt_exit();
 	return ret;
 }
 
 static void __exit skip_exit(void)
 {
+	skip_diag_exit();
 	skip_lwt_exit();
 	af_skip_exit();
+	skip_pool_exit();
 	pr_info("skip version (%s) is unloaded\n", SKIP_VERSION);
 }
 
@@ -0,0 +1,360 @@
+/* skip_pool.c
+ *
+ * skip over socket processing :
+ *
+ * Per-CPU pool of recycled host sockets. When an AF_SKIP socket is
+ * closed, its host socket on the default netns is disconnected and
+ * kept, if nothing of its use is left on it, and a later socket()
+ * of the same task takes it instead of __sock_create(). A host
+ * socket is only given to a task with the credentials and cgroups
+ * it was created with, so the LSM label, owner and cgroup of the
+ * host socket are those the task would get by __sock_create().
+ *
+ * TCP host sockets that carried a connection go through tcp_close()
+ * and are not recycled. Datagram sockets are, after a disconnect.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/net.h>
+#include <linux/cred.h>
+#include <linux/cgroup.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/stringify.h>
+#include <net/sock.h>
+#include <net/ip.h>
+#include <net/inet_sock.h>
+#include <net/net_namespace.h>
+#include <net/cls_cgroup.h>
+#include <net/netprio_cgroup.h>
+
+#include "skip.h"
+
+
+#ifdef pr_fmt
+#undef pr_fmt
+#endif
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+
+#define SKIP_POOL_MAX		64
+
+static unsigned int pool_size = 0;
+module_param(pool_size, uint, 0444);
+MODULE_PARM_DESC(pool_size, "host sockets pooled per cpu and class "
+		 "(0 disables the pool, max " __stringify(SKIP_POOL_MAX) ")");
+
+/* classes of pooled sockets */
+enum {
+	SKIP_POOL_TCP4,
+	SKIP_POOL_UDP4,
+	SKIP_POOL_TCP6,
+	SKIP_POOL_UDP6,
+	__SKIP_POOL_CLASS_MAX,
+};
+
+struct skip_pool_entry {
+	struct socket		*sock;
+	const struct cred	*cred;	/* created the socket, referenced */
+};
+
+struct skip_pool {
+	spinlock_t	lock;
+	unsigned int	count[__SKIP_POOL_CLASS_MAX];
+	/* oldest first */
+	struct skip_pool_entry entries[__SKIP_POOL_CLASS_MAX][SKIP_POOL_MAX];
+
+	/* statistics */
+	u64		hit;
+	u64		miss;
+	u64		recycle;
+	u64		evict;
+};
+
+static DEFINE_PER_CPU(struct skip_pool, skip_pools);
+
+static bool skip_pool_enabled __read_mostly;
+
+
+static int skip_pool_class(int family, int type, int protocol)
+{
+	int class;
+
+	switch (type) {
+	case SOCK_STREAM:
+		if (protocol && protocol != IPPROTO_TCP)
+			return -1;
+		class = SKIP_POOL_TCP4;
+		break;
+	case SOCK_DGRAM:
+		if (protocol && protocol != IPPROTO_UDP)
+			return -1;
+		class = SKIP_POOL_UDP4;
+		break;
+	default:
+		return -1;
+	}
+
+	switch (family) {
+	case AF_INET:
+		return class;
+	case AF_INET6:
+		return class + SKIP_POOL_TCP6;
+	}
+
+	return -1;
+}
+
+bool skip_pool_active(void)
+{
+	return skip_pool_enabled;
+}
+
+static bool skip_pool_match(struct skip_pool_entry *e)
+{
+	/* the socket is what __sock_create() by current would give.
+	 * the cred decides the LSM label and the owner, and
+	 * sk_alloc() takes the cgroups of current. */
+
+	struct sock *sk = e->sock->sk;
+	bool ret = true;
+
+	if (e->cred != current_cred())
+		return false;
+
+#ifdef CONFIG_SOCK_CGROUP_DATA
+	rcu_read_lock();
+	ret = (sock_cgroup_ptr(&sk->sk_cgrp_data) ==
+	       task_dfl_cgroup(current));
+	rcu_read_unlock();
+#endif
+#ifdef CONFIG_CGROUP_NET_CLASSID
+	if (sock_cgroup_classid(&sk->sk_cgrp_data) !=
+	    task_cls_classid(current))
+		ret = false;
+#endif
+#ifdef CONFIG_CGROUP_NET_PRIO
+	if (sock_cgroup_prioidx(&sk->sk_cgrp_data) !=
+	    task_netprioidx(current))
+		ret = false;
+#endif
+
+	return ret;
+}
+
+struct socket *skip_pool_get(int family, int type, int protocol)
+{
+	/* take the newest socket of the class for current. called in
+	 * process context before the host socket is created. */
+
+	int class, n;
+	struct skip_pool *pool;
+	struct skip_pool_entry *e;
+	struct socket *sock = NULL;
+	const struct cred *cred = NULL;
+
+	if (!skip_pool_enabled)
+		return NULL;
+
+	class = skip_pool_class(family, type, protocol);
+	if (class < 0)
+		return NULL;
+
+	pool = get_cpu_ptr(&skip_pools);
+	spin_lock(&pool->lock);
+	e = pool->entries[class];
+	for (n = pool->count[class] - 1; n >= 0; n--) {
+		if (!skip_pool_match(&e[n]))
+			continue;
+		sock = e[n].sock;
+		cred = e[n].cred;
+		pool->count[class]--;
+		memmove(&e[n], &e[n + 1],
+			sizeof(*e) * (pool->count[class] - n));
+		break;
+	}
+	if (sock)
+		pool->hit++;
+	else
+		pool->miss++;
+	spin_unlock(&pool->lock);
+	put_cpu_ptr(&skip_pools);
+
+	if (cred)
+		put_cred(cred);
+
+	return sock;
+}
+
+static bool skip_pool_reset(struct socket *sock)
+{
+	/* disconnect a used host socket, and check nothing of its
+	 * use is left on it. the port is released by the disconnect
+	 * unless bind() locked it. */
+
+	struct sock *sk = sock->sk;
+	struct sockaddr unspec = { .sa_family = AF_UNSPEC };
+	bool ret;
+
+	if (sk->sk_type == SOCK_DGRAM)
+		sock->ops->connect(sock, &unspec, sizeof(unspec), 0);
+
+	lock_sock(sk);
+	ret = (sk->sk_state == TCP_CLOSE && !inet_sk(sk)->inet_num &&
+	       !(sk->sk_userlocks & ~SOCK_BINDADDR_LOCK) &&
+	       !sk->sk_err && !sk_wmem_alloc_get(sk) &&
+	       skb_queue_empty(&sk->sk_receive_queue) &&
+	       skb_queue_empty(&sk->sk_error_queue));
+	if (ret) {
+		inet_reset_saddr(sk);
+		sk->sk_userlocks = 0;
+		sock_reset_flag(sk, SOCK_FASYNC);
+		inet_sk(sk)->bind_address_no_port = 0;
+		sock->state = SS_UNCONNECTED;
+	}
+	release_sock(sk);
+
+	return ret;
+}
+
+bool skip_pool_put(struct socket *sock, const struct cred *cred)
+{
+	/* recycle a host socket created by cred on the default netns,
+	 * evicting the oldest one if the pool is full. returns false
+	 * if the pool does not take it. */
+
+	int class;
+	struct skip_pool *pool;
+	struct skip_pool_entry *e, evicted = { NULL, NULL };
+	bool ret = false;
+
+	if (!skip_pool_enabled || !cred ||
+	    !net_eq(sock_net(sock->sk), &init_net))
+		return false;
+
+	class = skip_pool_class(sock->sk->sk_family, sock->type,
+				sock->sk->sk_protocol);
+	if (class < 0 || !skip_pool_reset(sock))
+		return false;
+
+	pool = get_cpu_ptr(&skip_pools);
+	spin_lock(&pool->lock);
+	e = pool->entries[class];
+	if (pool->count[class] == pool_size) {
+		evicted = e[0];
+		pool->count[class]--;
+		memmove(&e[0], &e[1], sizeof(*e) * pool->count[class]);
+		pool->evict++;
+	}
+	e[pool->count[class]].sock = sock;
+	e[pool->count[class]].cred = get_cred(cred);
+	pool->count[class]++;
+	pool->recycle++;
+	ret = true;
+	spin_unlock(&pool->lock);
+	put_cpu_ptr(&skip_pools);
+
+	if (evicted.sock) {
+		sock_release(evicted.sock);
+		put_cred(evicted.cred);
+	}
+
+	return ret;
+}
+
+static int skip_pool_seq_show(struct seq_file *seq, void *v)
+{
+	int cpu, class;
+	unsigned int count;
+	u64 hit = 0, miss = 0, recycle = 0, evict = 0;
+	struct skip_pool *pool;
+
+	for_each_possible_cpu(cpu) {
+		pool = per_cpu_ptr(&skip_pools, cpu);
+		spin_lock(&pool->lock);
+		hit += pool->hit;
+		miss += pool->miss;
+		recycle += pool->recycle;
+		evict += pool->evict;
+		spin_unlock(&pool->lock);
+	}
+
+	seq_printf(seq, "size %u\n", pool_size);
+	seq_printf(seq, "hit %llu\n", hit);
+	seq_printf(seq, "miss %llu\n", miss);
+	seq_printf(seq, "recycle %llu\n", recycle);
+	seq_printf(seq, "evict %llu\n", evict);
+
+	for_each_possible_cpu(cpu) {
+		pool = per_cpu_ptr(&skip_pools, cpu);
+		seq_printf(seq, "cpu%d", cpu);
+		for (class = 0; class < __SKIP_POOL_CLASS_MAX; class++) {
+			count = READ_ONCE(pool->count[class]);
+			seq_printf(seq, " %u", count);
+		}
+		seq_puts(seq, "\n");
+	}
+
+	return 0;
+}
+
+static int skip_pool_seq_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, skip_pool_seq_show, NULL);
+}
+
+static const struct file_operations skip_pool_fops = {
+	.owner		= THIS_MODULE,
+	.open		= skip_pool_seq_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+int skip_pool_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(&skip_pools, cpu)->lock);
+
+	if (pool_size > SKIP_POOL_MAX) {
+		pr_info("pool_size %u is truncated to %u\n",
+			pool_size, SKIP_POOL_MAX);
+		pool_size = SKIP_POOL_MAX;
+	}
+
+	if (!proc_create("skip_pool", 0444, init_net.proc_net,
+			 &skip_pool_fops)) {
+		pr_err("%s: failed to create /proc/net/skip_pool\n",
+		       __func__);
+		return -ENOMEM;
+	}
+
+	skip_pool_enabled = !!pool_size;
+
+	return 0;
+}
+
+void skip_pool_exit(void)
+{
+	int cpu, class;
+	struct skip_pool *pool;
+	struct skip_pool_entry *e;
+
+	skip_pool_enabled = false;
+	remove_proc_entry("skip_pool", init_net.proc_net);
+
+	for_each_possible_cpu(cpu) {
+		pool = per_cpu_ptr(&skip_pools, cpu);
+		for (class = 0; class < __SKIP_POOL_CLASS_MAX; class++) {
+			while (pool->count[class]) {
+				e = &pool->entries[class][--pool->count[class]];
+				sock_release(e->sock);
+				put_cred(e->cred);
+			}
+		}
+	}
+}
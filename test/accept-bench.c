@@ -0,0 +1,161 @@
+/* accept-bench.c
+ *
+ * measure connections per second accepted by an AF_SKIP (or native
+ * AF_INET/AF_INET6 for comparison) listener.
+ *
+ * server: accept-bench -s [-t] [-n count] [-p port] ADDRESS
+ * client: accept-bench -c [-n count] [-p port] [-j conns] ADDRESS
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: accept-bench [-s|-c] [-n count] [-p port] [-t] "
+		"[-j conns] ADDRESS\n"
+		"  -s          run as server (accept)\n"
+		"  -c          run as client (connect)\n"
+		"  -n count    number of connections (default 100000)\n"
+		"  -p port     port number (default 10000)\n"
+		"  -t          server uses native AF_INET/AF_INET6 socket\n"
+		"  -j conns    client connections in flight (default 16)\n");
+}
+
+static int server(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  int count, int native)
+{
+	int n, fd, cfd, on = 1;
+	struct timespec start, end;
+	double sec;
+
+	fd = socket(native ? saddr_s->ss_family : AF_SKIP, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)
+		perror("setsockopt");
+
+	if (bind(fd, (struct sockaddr *)saddr_s, addrlen) < 0) {
+		perror("bind");
+		return -1;
+	}
+
+	if (listen(fd, 4096) < 0) {
+		perror("listen");
+		return -1;
+	}
+
+	for (n = 0; n < count; n++) {
+		cfd = accept(fd, NULL, NULL);
+		if (cfd < 0) {
+			perror("accept");
+			break;
+		}
+		if (n == 0)
+			clock_gettime(CLOCK_MONOTONIC, &start);
+		close(cfd);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	sec = elapsed(&start, &end);
+	printf("%s: %d accepts in %.3f sec, %.0f conns/sec\n",
+	       native ? "native" : "skip", n, sec, n / sec);
+
+	close(fd);
+	return 0;
+}
+
+static int client(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  int count, int conns)
+{
+	int n, i, *fds;
+
+	fds = calloc(conns, sizeof(int));
+	if (!fds) {
+		perror("calloc");
+		return -1;
+	}
+
+	for (n = 0; n < count; n += conns) {
+		for (i = 0; i < conns && n + i < count; i++) {
+			fds[i] = socket(saddr_s->ss_family, SOCK_STREAM, 0);
+			if (fds[i] < 0) {
+				perror("socket");
+				return -1;
+			}
+			if (connect(fds[i], (struct sockaddr *)saddr_s,
+				    addrlen) < 0) {
+				perror("connect");
+				return -1;
+			}
+		}
+		while (i-- > 0)
+			close(fds[i]);
+	}
+
+	free(fds);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, count = 100000, port = 10000, native = 0, conns = 16;
+	int mode = 0;
+	socklen_t addrlen;
+	struct sockaddr_storage saddr_s;
+
+	while ((ch = getopt(argc, argv, "scn:p:tj:h")) != -1) {
+		switch (ch) {
+		case 's':
+		case 'c':
+			mode = ch;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 't':
+			native = 1;
+			break;
+		case 'j':
+			conns = atoi(optarg);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (!mode || optind >= argc || count <= 0 || conns <= 0) {
+		usage();
+		return -1;
+	}
+
+	if (parse_addr(argv[optind], port, &saddr_s, &addrlen) < 0)
+		return -1;
+
+	if (mode == 's')
+		return server(&saddr_s, addrlen, count, native);
+
+	return client(&saddr_s, addrlen, count, conns);
+}
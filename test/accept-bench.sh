@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# connections per second accepted by an AF_SKIP listener in a netns,
+# against a native listener on the host. Clients connect from the
+# host netns to the host address of the skip route.
+
+. ./common.sh
+
+bench=./accept-bench
+nsname=skip-bench
+count=${COUNT:-100000}
+port=10000
+
+make -s accept-bench || exit 1
+
+# setup test namespace
+netns_add $nsname
+skip_route $nsname 172.16.0.0/16 127.0.0.1
+
+
+echo accept-bench: native listener on host
+$bench -s -t -n $count -p $port 127.0.0.1 &
+sleep 0.5
+$bench -c -n $count -p $port 127.0.0.1
+wait
+echo
+
+port=$((port + 1))
+echo accept-bench: AF_SKIP listener in netns $nsname
+$ip netns exec $nsname $bench -s -n $count -p $port 172.16.0.1 &
+sleep 0.5
+$bench -c -n $count -p $port 127.0.0.1
+wait
+echo
+
+
+netns_del $nsname
@@ -0,0 +1,103 @@
+/* bind-bench.c
+ *
+ * measure the rate of socket() + bind() on AF_SKIP (or native
+ * AF_INET/AF_INET6 for comparison) sockets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: bind-bench [-n count] [-p baseport] [-t] ADDRESS\n"
+		"  -n count    number of sockets to bind (default 10000)\n"
+		"  -p port     first port number (default 20000)\n"
+		"  -t          use native AF_INET/AF_INET6 instead of AF_SKIP\n");
+}
+
+int main(int argc, char **argv)
+{
+	int ch, n, count = 10000, port = 20000, native = 0;
+	int family, *fds, ret = 0;
+	socklen_t addrlen;
+	struct sockaddr_storage saddr_s;
+	struct timespec start, end;
+	double sec;
+
+	while ((ch = getopt(argc, argv, "n:p:th")) != -1) {
+		switch (ch) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 't':
+			native = 1;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (optind >= argc || count <= 0 || port + count > 65536) {
+		usage();
+		return -1;
+	}
+
+	if (parse_addr(argv[optind], port, &saddr_s, &addrlen) < 0)
+		return -1;
+	family = saddr_s.ss_family;
+
+	fds = calloc(count, sizeof(int));
+	if (!fds) {
+		perror("calloc");
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < count; n++) {
+		fds[n] = socket(native ? family : AF_SKIP, SOCK_STREAM, 0);
+		if (fds[n] < 0) {
+			perror("socket");
+			ret = -1;
+			break;
+		}
+
+		set_port(&saddr_s, port + n);
+
+		if (bind(fds[n], (struct sockaddr *)&saddr_s, addrlen) < 0) {
+			perror("bind");
+			close(fds[n]);
+			ret = -1;
+			break;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	sec = elapsed(&start, &end);
+	printf("%s: %d binds in %.3f sec, %.0f binds/sec\n",
+	       native ? "native" : "skip", n, sec, n / sec);
+
+	while (n-- > 0)
+		close(fds[n]);
+	free(fds);
+
+	return ret;
+}
@@ -0,0 +1,31 @@
+#!/bin/bash
+#
+# bind() rate of AF_SKIP sockets against native sockets.
+# Run with the skip module to be measured loaded, e.g., once with a
+# module before and once after a change to compare.
+
+. ./common.sh
+
+bench=./bind-bench
+nsname=skip-bench
+count=${COUNT:-10000}
+
+make -s bind-bench || exit 1
+
+# setup test namespace with a handful of skip routes
+netns_add $nsname
+for i in `seq 1 32`; do
+	skip_route $nsname 172.16.$i.0/24 127.0.0.1
+done
+
+
+echo bind-bench: native sockets on host
+$bench -n $count -t 127.0.0.1
+echo
+
+echo bind-bench: AF_SKIP sockets in netns $nsname
+$ip netns exec $nsname $bench -n $count 172.16.16.1
+echo
+
+
+netns_del $nsname
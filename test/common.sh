@@ -0,0 +1,34 @@
+# common.sh
+#
+# netns and skip route setup shared by the benchmark and test scripts.
+# Sourced from this directory, after ip of the iproute2 with skip encap
+# is built.
+
+ip=../iproute2-4.10.0/ip/ip
+
+netns_add() {
+	# netns_add NAME: create netns NAME, if not yet, with lo up
+	if [ ! -e /var/run/netns/$1 ]; then
+		$ip netns add $1
+	fi
+	$ip netns exec $1 ifconfig lo up
+}
+
+skip_route() {
+	# skip_route NAME PREFIX HOST [FLAGS...]: add a skip route to
+	# netns NAME, inbound and outbound unless FLAGS are given
+	local ns=$1 prefix=$2 host=$3
+
+	shift 3
+	$ip netns exec $ns $ip route add to $prefix dev lo \
+		encap skip host $host ${*:-inbound outbound}
+}
+
+netns_del() {
+	# netns_del NAME...
+	local ns
+
+	for ns in "$@"; do
+		$ip netns del $ns
+	done
+}
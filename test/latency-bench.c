@@ -0,0 +1,289 @@
+/* latency-bench.c
+ *
+ * measure TCP request/response latency percentiles of AF_SKIP (or
+ * native AF_INET/AF_INET6 for comparison) sockets, with busy poll
+ * (SO_BUSY_POLL) and with the client waiting in read() or poll().
+ * These are where 4.10 busy polls: read() by SO_BUSY_POLL, poll()
+ * by SO_BUSY_POLL and sysctl net.core.busy_poll. epoll_wait() does
+ * not busy poll before 4.12.
+ *
+ * server: latency-bench -s [-t] [-p port] ADDRESS
+ * client: latency-bench -c [-t] [-b usec] [-w read|poll]
+ *                       [-n count] [-l len] [-p port] ADDRESS
+ *
+ * The client prints the NAPI id and the CPU that the socket received
+ * from (SO_INCOMING_NAPI_ID, SO_INCOMING_CPU).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+/* older headers */
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL		46
+#endif
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU		49
+#endif
+#ifndef SO_INCOMING_NAPI_ID
+#define SO_INCOMING_NAPI_ID	56
+#endif
+
+#define WAIT_READ	0
+#define WAIT_POLL	1
+
+#define LEN_MAX		4096
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: latency-bench [-s|-c] [-t] [-b usec] "
+		"[-w read|poll] [-n count] [-l len] [-p port] "
+		"ADDRESS\n"
+		"  -s          run as server (echo)\n"
+		"  -c          run as client\n"
+		"  -t          use native AF_INET/AF_INET6 socket\n"
+		"  -b usec     SO_BUSY_POLL of the client socket\n"
+		"  -w wait     how the client waits for responses "
+		"(default read)\n"
+		"  -n count    number of transactions (default 100000)\n"
+		"  -l len      message length (default 64)\n"
+		"  -p port     port number (default 10000)\n");
+}
+
+static int read_full(int fd, char *buf, size_t len)
+{
+	ssize_t ret;
+	size_t done = 0;
+
+	while (done < len) {
+		ret = read(fd, buf + done, len - done);
+		if (ret <= 0)
+			return -1;
+		done += ret;
+	}
+
+	return 0;
+}
+
+static int cmp_ns(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static long long ns(struct timespec *t)
+{
+	return t->tv_sec * 1000000000LL + t->tv_nsec;
+}
+
+static int server(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  int native)
+{
+	int fd, cfd, on = 1;
+	char buf[LEN_MAX];
+	ssize_t ret;
+
+	fd = socket(native ? saddr_s->ss_family : AF_SKIP, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)
+		perror("setsockopt");
+
+	if (bind(fd, (struct sockaddr *)saddr_s, addrlen) < 0) {
+		perror("bind");
+		return -1;
+	}
+
+	if (listen(fd, 1) < 0) {
+		perror("listen");
+		return -1;
+	}
+
+	cfd = accept(fd, NULL, NULL);
+	if (cfd < 0) {
+		perror("accept");
+		return -1;
+	}
+
+	if (setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)
+		perror("setsockopt(TCP_NODELAY)");
+
+	/* echo whatever arrives until the client closes */
+	while ((ret = read(cfd, buf, sizeof(buf))) > 0) {
+		if (write(cfd, buf, ret) != ret) {
+			perror("write");
+			break;
+		}
+	}
+
+	close(cfd);
+	close(fd);
+
+	return 0;
+}
+
+static int wait_readable(int fd, int wait)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	if (wait == WAIT_POLL)
+		return poll(&pfd, 1, -1) == 1 ? 0 : -1;
+
+	return 0;
+}
+
+static int client(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  int native, int busy_poll, int wait, int count,
+		  size_t len)
+{
+	int fd, on = 1, n, napi_id = 0, cpu = -1;
+	char buf[LEN_MAX];
+	long long *lat;
+	socklen_t optlen;
+	struct timespec start, end;
+
+	lat = calloc(count, sizeof(*lat));
+	if (!lat) {
+		perror("calloc");
+		return -1;
+	}
+	memset(buf, 'x', len);
+
+	fd = socket(native ? saddr_s->ss_family : AF_SKIP, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (busy_poll && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+				    &busy_poll, sizeof(busy_poll)) < 0) {
+		perror("setsockopt(SO_BUSY_POLL)");
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr *)saddr_s, addrlen) < 0) {
+		perror("connect");
+		return -1;
+	}
+
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)
+		perror("setsockopt(TCP_NODELAY)");
+
+	for (n = 0; n < count; n++) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (write(fd, buf, len) != len) {
+			perror("write");
+			return -1;
+		}
+		if (wait_readable(fd, wait) < 0 ||
+		    read_full(fd, buf, len) < 0) {
+			perror("read");
+			return -1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		lat[n] = ns(&end) - ns(&start);
+	}
+
+	optlen = sizeof(napi_id);
+	getsockopt(fd, SOL_SOCKET, SO_INCOMING_NAPI_ID, &napi_id, &optlen);
+	optlen = sizeof(cpu);
+	getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &optlen);
+
+	qsort(lat, count, sizeof(*lat), cmp_ns);
+
+	printf("%s busy_poll %d wait %s: p50 %.2f p90 %.2f p99 %.2f "
+	       "p99.9 %.2f max %.2f usec\n",
+	       native ? "native" : "skip", busy_poll,
+	       wait == WAIT_READ ? "read" : "poll",
+	       lat[count * 50 / 100] / 1000.0,
+	       lat[count * 90 / 100] / 1000.0,
+	       lat[count * 99 / 100] / 1000.0,
+	       lat[count * 999 / 1000] / 1000.0,
+	       lat[count - 1] / 1000.0);
+	printf("  napi_id %d, incoming cpu %d\n", napi_id, cpu);
+
+	close(fd);
+	free(lat);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, port = 10000, native = 0, role = 0, busy_poll = 0;
+	int wait = WAIT_READ, count = 100000;
+	size_t len = 64;
+	socklen_t addrlen;
+	struct sockaddr_storage saddr_s;
+
+	while ((ch = getopt(argc, argv, "sctb:w:n:l:p:h")) != -1) {
+		switch (ch) {
+		case 's':
+		case 'c':
+			role = ch;
+			break;
+		case 't':
+			native = 1;
+			break;
+		case 'b':
+			busy_poll = atoi(optarg);
+			break;
+		case 'w':
+			if (strcmp(optarg, "read") == 0)
+				wait = WAIT_READ;
+			else if (strcmp(optarg, "poll") == 0)
+				wait = WAIT_POLL;
+			else {
+				usage();
+				return -1;
+			}
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'l':
+			len = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (!role || optind >= argc || count < 1 || !len || len > LEN_MAX) {
+		usage();
+		return -1;
+	}
+
+	if (parse_addr(argv[optind], port, &saddr_s, &addrlen) < 0)
+		return -1;
+
+	if (role == 's')
+		return server(&saddr_s, addrlen, native);
+
+	return client(&saddr_s, addrlen, native, busy_poll, wait, count,
+		      len);
+}
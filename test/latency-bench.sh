@@ -0,0 +1,50 @@
+#!/bin/bash
+#
+# TCP request/response latency percentiles of AF_SKIP sockets in a
+# netns against native sockets on the host, waiting in read() and
+# poll(), with and without SO_BUSY_POLL on the client. The echo
+# server is a native socket on the host. Loopback has no NAPI id and
+# nothing to busy poll, use an address of a real NIC as ADDRESS to
+# measure the benefit. Busy poll from poll() also needs sysctl
+# net.core.busy_poll. epoll_wait() does not busy poll on 4.10.
+
+. ./common.sh
+
+bench=./latency-bench
+nsname=skip-bench
+count=${COUNT:-100000}
+busy_poll=${BUSY_POLL:-50}
+addr=${ADDRESS:-127.0.0.1}
+port=10000
+
+make -s latency-bench || exit 1
+
+# setup test namespace
+netns_add $nsname
+skip_route $nsname 0.0.0.0/0 $addr
+
+
+for wait in read poll; do
+	for bp in 0 $busy_poll; do
+		echo latency-bench: native socket on host, $wait, busy_poll $bp
+		$bench -s -t -p $port $addr &
+		sleep 0.5
+		$bench -c -t -w $wait -b $bp -n $count -p $port $addr
+		wait
+		port=$((port + 1))
+		echo
+
+		echo latency-bench: AF_SKIP socket in netns $nsname, \
+			$wait, busy_poll $bp
+		$bench -s -t -p $port $addr &
+		sleep 0.5
+		$ip netns exec $nsname \
+			$bench -c -w $wait -b $bp -n $count -p $port $addr
+		wait
+		port=$((port + 1))
+		echo
+	done
+done
+
+
+netns_del $nsname
@@ -0,0 +1,153 @@
+/* recvmsg-bench.c
+ *
+ * measure the cost of recvmsg() with msg_name on AF_SKIP (or native
+ * AF_INET/AF_INET6 for comparison) UDP sockets. AF_SKIP sockets
+ * translate the source address in msg_name, and this is to keep the
+ * overhead of that in check.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+#define BATCH	32
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: recvmsg-bench [-n count] [-p port] [-d dest] [-t] "
+		"ADDRESS\n"
+		"  -n count    number of datagrams to receive "
+		"(default 1000000)\n"
+		"  -p port     port to bind (default 20000)\n"
+		"  -d dest     address to send to (default ADDRESS)\n"
+		"  -t          use native AF_INET/AF_INET6 instead of AF_SKIP\n");
+}
+
+static void print_addr(const char *prefix, struct sockaddr_storage *ss)
+{
+	char buf[INET6_ADDRSTRLEN];
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)ss;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)ss;
+
+	if (ss->ss_family == AF_INET)
+		printf("%s%s:%u\n", prefix,
+		       inet_ntop(AF_INET, &sa4->sin_addr, buf, sizeof(buf)),
+		       ntohs(sa4->sin_port));
+	else if (ss->ss_family == AF_INET6)
+		printf("%s%s:%u\n", prefix,
+		       inet_ntop(AF_INET6, &sa6->sin6_addr, buf, sizeof(buf)),
+		       ntohs(sa6->sin6_port));
+	else
+		printf("%sfamily %u\n", prefix, ss->ss_family);
+}
+
+int main(int argc, char **argv)
+{
+	int ch, n, i, count = 1000000, port = 20000, native = 0;
+	int rfd, sfd, family, ret = 0;
+	char *dest = NULL, buf[64];
+	socklen_t addrlen, destlen;
+	struct sockaddr_storage saddr_s, daddr_s, from;
+	struct timespec start, end;
+	struct msghdr msg;
+	struct iovec iov;
+	double sec = 0;
+
+	while ((ch = getopt(argc, argv, "n:p:d:th")) != -1) {
+		switch (ch) {
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'd':
+			dest = optarg;
+			break;
+		case 't':
+			native = 1;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (optind >= argc || count <= 0) {
+		usage();
+		return -1;
+	}
+
+	if (parse_addr(argv[optind], port, &saddr_s, &addrlen) < 0 ||
+	    parse_addr(dest ? dest : argv[optind], port, &daddr_s,
+		       &destlen) < 0)
+		return -1;
+	family = native ? saddr_s.ss_family : AF_SKIP;
+
+	rfd = socket(family, SOCK_DGRAM, 0);
+	sfd = socket(native ? daddr_s.ss_family : AF_SKIP, SOCK_DGRAM, 0);
+	if (rfd < 0 || sfd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (bind(rfd, (struct sockaddr *)&saddr_s, addrlen) < 0) {
+		perror("bind");
+		return -1;
+	}
+
+	memset(buf, 0, sizeof(buf));
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf);
+
+	for (n = 0; n < count; n += BATCH) {
+		for (i = 0; i < BATCH; i++) {
+			if (sendto(sfd, buf, sizeof(buf), 0,
+				   (struct sockaddr *)&daddr_s, destlen) < 0) {
+				perror("sendto");
+				ret = -1;
+				goto out;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < BATCH; i++) {
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_name = &from;
+			msg.msg_namelen = sizeof(from);
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			if (recvmsg(rfd, &msg, 0) < 0) {
+				perror("recvmsg");
+				ret = -1;
+				goto out;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		sec += elapsed(&start, &end);
+	}
+
+out:
+	printf("%s: %d recvmsg in %.3f sec, %.0f ns/recvmsg\n",
+	       native ? "native" : "skip", n, sec,
+	       n ? sec * 1000000000.0 / n : 0);
+	if (n)
+		print_addr("last source: ", &from);
+
+	close(sfd);
+	close(rfd);
+
+	return ret;
+}
@@ -0,0 +1,30 @@
+#!/bin/bash
+#
+# recvmsg() cost with msg_name of AF_SKIP UDP sockets, whose source
+# addresses are translated to the virtual ones, against native
+# sockets. Run with the skip module to be measured loaded.
+
+. ./common.sh
+
+bench=./recvmsg-bench
+nsname=skip-bench
+count=${COUNT:-1000000}
+
+make -s recvmsg-bench || exit 1
+
+# setup test namespace with a host route, so that the receiver has
+# a virtual address other than the host address
+netns_add $nsname
+skip_route $nsname 0.0.0.0/0 127.0.0.1
+
+
+echo recvmsg-bench: native sockets on host
+$bench -n $count -t 127.0.0.1
+echo
+
+echo recvmsg-bench: AF_SKIP sockets in netns $nsname
+$ip netns exec $nsname $bench -n $count -d 127.0.0.1 172.16.16.1
+echo
+
+
+netns_del $nsname
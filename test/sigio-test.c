@@ -0,0 +1,177 @@
+/* sigio-test.c
+ *
+ * check SIGIO of O_ASYNC is delivered for events on AF_SKIP sockets
+ * (or native AF_INET/AF_INET6 for comparison). A receiver with
+ * O_ASYNC and F_SETOWN of this process, and a sender are opened in
+ * the same process.
+ *
+ *   early:  O_ASYNC is set before bind(), before the host socket
+ *           exists. a datagram is sent to the receiver.
+ *   late:   O_ASYNC is set after bind(). a datagram is sent.
+ *   listen: O_ASYNC is set on a TCP listener. the sender connects.
+ *
+ * usage: sigio-test [-t] [-p port] early|late|listen ADDRESS [DEST]
+ *
+ * exit status: 0 pass, 1 fail.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+static volatile sig_atomic_t sigio;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: sigio-test [-t] [-p port] early|late|listen "
+		"ADDRESS [DEST]\n"
+		"  -t          use native AF_INET/AF_INET6 sockets\n"
+		"  -p port     port number (default 10000)\n"
+		"  ADDRESS     address the receiver binds\n"
+		"  DEST        address the sender sends to "
+		"(default ADDRESS)\n");
+}
+
+static void sigio_handler(int sig)
+{
+	sigio++;
+}
+
+static int set_async(int fd)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || fcntl(fd, F_SETOWN, getpid()) < 0 ||
+	    fcntl(fd, F_SETFL, flags | O_ASYNC) < 0) {
+		perror("fcntl");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int wait_sigio(void)
+{
+	int n;
+
+	/* poll() is interrupted by SIGIO, or times out */
+	for (n = 0; n < 10 && !sigio; n++)
+		poll(NULL, 0, 100);
+
+	return sigio ? PASS : FAIL;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, port = 10000, native = 0, on = 1, type;
+	int rfd, sfd, early = 0, ret;
+	char *test;
+	socklen_t addrlen, destlen;
+	struct sockaddr_storage saddr_s, daddr_s;
+	struct sigaction sa;
+
+	while ((ch = getopt(argc, argv, "tp:h")) != -1) {
+		switch (ch) {
+		case 't':
+			native = 1;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage();
+			return FAIL;
+		}
+	}
+
+	if (optind + 1 >= argc) {
+		usage();
+		return FAIL;
+	}
+	test = argv[optind];
+
+	if (parse_addr(argv[optind + 1], port, &saddr_s, &addrlen) < 0 ||
+	    parse_addr(optind + 2 < argc ? argv[optind + 2] :
+		       argv[optind + 1], port, &daddr_s, &destlen) < 0)
+		return FAIL;
+
+	if (strcmp(test, "early") == 0) {
+		type = SOCK_DGRAM;
+		early = 1;
+	} else if (strcmp(test, "late") == 0)
+		type = SOCK_DGRAM;
+	else if (strcmp(test, "listen") == 0)
+		type = SOCK_STREAM;
+	else {
+		usage();
+		return FAIL;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sigio_handler;
+	sa.sa_flags = SA_RESTART;	/* connect() is signaled */
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGIO, &sa, NULL) < 0) {
+		perror("sigaction");
+		return FAIL;
+	}
+
+	rfd = socket(native ? saddr_s.ss_family : AF_SKIP, type, 0);
+	sfd = socket(native ? daddr_s.ss_family : AF_SKIP, type, 0);
+	if (rfd < 0 || sfd < 0) {
+		perror("socket");
+		return FAIL;
+	}
+
+	if (setsockopt(rfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)
+		perror("setsockopt");
+
+	if (early && set_async(rfd) < 0)
+		return FAIL;
+
+	if (bind(rfd, (struct sockaddr *)&saddr_s, addrlen) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+	if (type == SOCK_STREAM && listen(rfd, 1) < 0) {
+		perror("listen");
+		return FAIL;
+	}
+
+	if (!early && set_async(rfd) < 0)
+		return FAIL;
+
+	if (type == SOCK_STREAM)
+		ret = connect(sfd, (struct sockaddr *)&daddr_s, destlen);
+	else
+		ret = sendto(sfd, "x", 1, 0, (struct sockaddr *)&daddr_s,
+			     destlen);
+	if (ret < 0) {
+		perror(type == SOCK_STREAM ? "connect" : "sendto");
+		return FAIL;
+	}
+
+	ret = wait_sigio();
+	printf("%s %s: %s\n", native ? "native" : "skip", test,
+	       ret == PASS ? "pass" : "no SIGIO");
+
+	close(sfd);
+	close(rfd);
+
+	return ret;
+}
@@ -0,0 +1,33 @@
+#!/bin/bash
+#
+# SIGIO of O_ASYNC on AF_SKIP sockets in a netns, against native
+# sockets on the host. O_ASYNC is set before and after the host
+# socket is created. Run with the skip module loaded.
+
+. ./common.sh
+
+test=./sigio-test
+nsname=skip-test
+port=10000
+fail=0
+
+make -s sigio-test || exit 1
+
+# setup test namespace
+netns_add $nsname
+skip_route $nsname 0.0.0.0/0 127.0.0.1
+
+
+for t in early late listen; do
+	$test -t -p $port $t 127.0.0.1
+	port=$((port + 1))
+
+	$ip netns exec $nsname $test -p $port $t 172.16.0.1 127.0.0.1
+	[ $? -ne 0 ] && fail=1
+	port=$((port + 1))
+done
+
+
+netns_del $nsname
+
+exit $fail
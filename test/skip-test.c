@@ -0,0 +1,937 @@
+/* skip-test.c
+ *
+ * behaviour tests of AF_SKIP sockets over the skip routes set up by
+ * skip-test.sh. AF_SKIP sockets are opened in the netns given by -n,
+ * and the native sockets they talk to in the netns the test runs in,
+ * or in the one given by -N.
+ *
+ *   wildcard: a socket bound to 0.0.0.0 accepts connections and
+ *             receives datagrams on every host ADDRESS of the
+ *             inbound skip routes.
+ *   v4v6:     IPv4 sockets bound to ADDRESS of a v4v6map route
+ *             over IPv6 host sockets see their own and the peer
+ *             addresses in IPv4, and reply to them.
+ *   policy:   INBOUND and OUTBOUND are on an inbound only and an
+ *             outbound only route, to host INHOST and OUTHOST.
+ *             sockets connect() and listen() as the routes permit,
+ *             and a wildcard bind listens on INHOST only.
+ *   srcs:     sockets bound to ADDRESS with port 0, of a route with
+ *             a source address pool of HOST..., connect() from more
+ *             than one of them and show ADDRESS as their name.
+ *   connect:  unbound sockets are bound on connect() and the first
+ *             sendto() to ADDRESS, whose source is on a skip route.
+ *             connect() to REJECT, whose source is on a route not
+ *             permitting outbound, fails with EPERM, and to OFFROUTE,
+ *             whose source is on no skip route, with ENONET.
+ *   netns:    the host sockets of a socket bound to ADDRESS are in
+ *             the netns given by -N, where HOST is reached, and not
+ *             in the netns the test runs in.
+ *   reval:    the route of ADDRESS to HOST is changed by the command
+ *             of -c. a socket bound before it fails listen() with
+ *             ENONET, a connection from before it lives on, and a
+ *             new socket is bound through the new route to NEWHOST.
+ *   reset:    the route of ADDRESS to HOST is deleted by the command
+ *             of -c, and a connection over it is aborted (with the
+ *             reset_stale module parameter).
+ *   packet:   a datagram of a native socket of the netns of -n to
+ *             DEST, of a packet mode route, arrives at the netns
+ *             given by -N, where DEST is a local address.
+ *   dcache:   sendto() of a socket bound by its first sendto() to
+ *             ADDRESS succeeds, and fails with EPERM to REJECT and
+ *             with EADDRNOTAVAIL to OFFROUTE (see connect), each time.
+ *             after the route of ADDRESS is deleted by the command of
+ *             -c, sendto() to ADDRESS fails too.
+ *
+ * usage: skip-test [-p port] -n NETNS [-N NETNS] [-c CMD] CASE
+ *                  [ADDRESS...]
+ *
+ * exit status: 0 pass, 1 fail.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+static int port = 10000;
+static int selfns, skipns, peerns;
+static char *cmd;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: skip-test [-p port] -n NETNS [-N NETNS] [-c CMD] "
+		"CASE [ADDRESS...]\n"
+		"  -p port     port number (default 10000)\n"
+		"  -n NETNS    netns of the AF_SKIP sockets\n"
+		"  -N NETNS    netns of the native sockets "
+		"(default the current one)\n"
+		"  -c CMD      command changing the routes in a case\n"
+		"  CASE        wildcard|v4v6|policy|srcs|connect|netns|"
+		"reval|reset|packet|dcache\n");
+}
+
+static int netns_open(const char *name)
+{
+	int fd;
+	char path[256];
+
+	if (strchr(name, '/'))
+		snprintf(path, sizeof(path), "%s", name);
+	else
+		snprintf(path, sizeof(path), "/var/run/netns/%s", name);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		perror(path);
+
+	return fd;
+}
+
+static int netns_socket(int nsfd, int family, int type)
+{
+	/* a socket is of the netns it is created in */
+
+	int fd, on = 1;
+
+	if (setns(nsfd, CLONE_NEWNET) < 0) {
+		perror("setns");
+		return -1;
+	}
+	fd = socket(family, type, 0);
+	if (fd < 0)
+		perror("socket");
+	else if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on,
+			    sizeof(on)) < 0)
+		perror("setsockopt");
+	if (setns(selfns, CLONE_NEWNET) < 0) {
+		perror("setns");
+		exit(FAIL);
+	}
+
+	return fd;
+}
+
+static int skip_socket(int type)
+{
+	return netns_socket(skipns, AF_SKIP, type);
+}
+
+static int peer_socket(int family, int type)
+{
+	return netns_socket(peerns, family, type);
+}
+
+static int wait_readable(int fd)
+{
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+	return poll(&pfd, 1, 1000) == 1 ? 0 : -1;
+}
+
+static int result(const char *name, int ok)
+{
+	printf("%s: %s\n", name, ok ? "pass" : "FAIL");
+
+	return ok ? PASS : FAIL;
+}
+
+static int run_cmd(void)
+{
+	if (!cmd) {
+		usage();
+		return -1;
+	}
+	if (system(cmd) != 0) {
+		fprintf(stderr, "'%s' failed\n", cmd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int expect(const char *name, int ret, int err)
+{
+	/* ret of a syscall, that is to fail with err, or succeed if
+	 * err is 0 */
+
+	int ok = err ? (ret < 0 && errno == err) : ret >= 0;
+
+	if (ok || ret >= 0)
+		printf("%s: %s\n", name, ok ? "pass" : "FAIL");
+	else
+		printf("%s: FAIL (%s)\n", name, strerror(errno));
+
+	return ok ? PASS : FAIL;
+}
+
+static int sockaddr_equal(struct sockaddr_storage *a,
+			  struct sockaddr_storage *b)
+{
+	struct sockaddr_in *a4 = (struct sockaddr_in *)a;
+	struct sockaddr_in *b4 = (struct sockaddr_in *)b;
+	struct sockaddr_in6 *a6 = (struct sockaddr_in6 *)a;
+	struct sockaddr_in6 *b6 = (struct sockaddr_in6 *)b;
+
+	if (a->ss_family != b->ss_family)
+		return 0;
+	if (a->ss_family == AF_INET)
+		return a4->sin_addr.s_addr == b4->sin_addr.s_addr &&
+			a4->sin_port == b4->sin_port;
+
+	return !memcmp(&a6->sin6_addr, &b6->sin6_addr,
+		       sizeof(a6->sin6_addr)) &&
+		a6->sin6_port == b6->sin6_port;
+}
+
+static int test_wildcard(int argc, char **argv)
+{
+	int n, lfd, ufd, cfd, afd, ret = PASS;
+	char buf[16], name[64];
+	socklen_t len;
+	struct sockaddr_in any;
+	struct sockaddr_storage ss;
+
+	memset(&any, 0, sizeof(any));
+	any.sin_family = AF_INET;
+	any.sin_port = htons(port);
+
+	lfd = skip_socket(SOCK_STREAM);
+	ufd = skip_socket(SOCK_DGRAM);
+	if (lfd < 0 || ufd < 0)
+		return FAIL;
+
+	if (bind(lfd, (struct sockaddr *)&any, sizeof(any)) < 0 ||
+	    listen(lfd, 8) < 0 ||
+	    bind(ufd, (struct sockaddr *)&any, sizeof(any)) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+
+	for (n = 0; n < argc; n++) {
+		if (parse_addr(argv[n], port, &ss, &len) < 0)
+			return FAIL;
+
+		cfd = peer_socket(ss.ss_family, SOCK_STREAM);
+		if (cfd < 0)
+			return FAIL;
+		if (connect(cfd, (struct sockaddr *)&ss, len) < 0)
+			perror("connect");
+		afd = wait_readable(lfd) ? -1 : accept(lfd, NULL, NULL);
+		snprintf(name, sizeof(name), "wildcard accept on %s",
+			 argv[n]);
+		ret |= result(name, afd >= 0);
+		if (afd >= 0)
+			close(afd);
+		close(cfd);
+
+		cfd = peer_socket(ss.ss_family, SOCK_DGRAM);
+		if (cfd < 0)
+			return FAIL;
+		if (sendto(cfd, "x", 1, 0, (struct sockaddr *)&ss, len) < 0)
+			perror("sendto");
+		snprintf(name, sizeof(name), "wildcard recv on %s", argv[n]);
+		ret |= result(name, !wait_readable(ufd) &&
+			      recv(ufd, buf, sizeof(buf), 0) == 1);
+		close(cfd);
+	}
+
+	close(ufd);
+	close(lfd);
+
+	return ret;
+}
+
+static int test_v4v6(int argc, char **argv)
+{
+	int lfd, ufd, cfd, afd, ret = PASS;
+	char buf[16];
+	socklen_t len, alen;
+	struct sockaddr_storage ss, name, peer;
+
+	if (argc < 1 || parse_addr(argv[0], port, &ss, &len) < 0 ||
+	    ss.ss_family != AF_INET) {
+		usage();
+		return FAIL;
+	}
+
+	lfd = skip_socket(SOCK_STREAM);
+	ufd = skip_socket(SOCK_DGRAM);
+	if (lfd < 0 || ufd < 0)
+		return FAIL;
+
+	if (bind(lfd, (struct sockaddr *)&ss, len) < 0 ||
+	    listen(lfd, 8) < 0 ||
+	    bind(ufd, (struct sockaddr *)&ss, len) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+
+	alen = sizeof(name);
+	ret |= result("v4v6 getsockname",
+		      !getsockname(lfd, (struct sockaddr *)&name, &alen) &&
+		      sockaddr_equal(&name, &ss));
+
+	/* the native IPv4 peer reaches the IPv6 host socket */
+	cfd = peer_socket(AF_INET, SOCK_STREAM);
+	if (cfd < 0)
+		return FAIL;
+	if (connect(cfd, (struct sockaddr *)&ss, len) < 0)
+		perror("connect");
+	alen = sizeof(name);
+	getsockname(cfd, (struct sockaddr *)&name, &alen);
+	alen = sizeof(peer);
+	afd = wait_readable(lfd) ? -1 :
+		accept(lfd, (struct sockaddr *)&peer, &alen);
+	ret |= result("v4v6 accept peer", afd >= 0 &&
+		      sockaddr_equal(&peer, &name));
+	if (afd >= 0)
+		close(afd);
+	close(cfd);
+
+	cfd = peer_socket(AF_INET, SOCK_DGRAM);
+	if (cfd < 0)
+		return FAIL;
+	if (sendto(cfd, "x", 1, 0, (struct sockaddr *)&ss, len) < 0)
+		perror("sendto");
+	alen = sizeof(name);
+	getsockname(cfd, (struct sockaddr *)&name, &alen);
+	alen = sizeof(peer);
+	ret |= result("v4v6 recvfrom peer", !wait_readable(ufd) &&
+		      recvfrom(ufd, buf, sizeof(buf), 0,
+			       (struct sockaddr *)&peer, &alen) == 1 &&
+		      sockaddr_equal(&peer, &name));
+
+	/* the reply to the IPv4 peer is sent from the IPv6 host socket */
+	if (sendto(ufd, "y", 1, 0, (struct sockaddr *)&peer, alen) < 0)
+		perror("sendto");
+	ret |= result("v4v6 reply", !wait_readable(cfd) &&
+		      recv(cfd, buf, sizeof(buf), 0) == 1);
+	close(cfd);
+
+	close(ufd);
+	close(lfd);
+
+	return ret;
+}
+
+static int test_policy(int argc, char **argv)
+{
+	int n, lfd, sfd, cfd, afd, ret = PASS;
+	socklen_t len[4];
+	struct sockaddr_storage ss[4];
+	struct sockaddr_in any;
+
+	if (argc < 4) {
+		usage();
+		return FAIL;
+	}
+	for (n = 0; n < 4; n++)
+		if (parse_addr(argv[n], port, &ss[n], &len[n]) < 0)
+			return FAIL;
+
+	/* a native listener on INHOST to connect() to */
+	lfd = peer_socket(ss[2].ss_family, SOCK_STREAM);
+	if (lfd < 0 ||
+	    bind(lfd, (struct sockaddr *)&ss[2], len[2]) < 0 ||
+	    listen(lfd, 8) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+
+	/* inbound only: listen() and no connect() */
+	sfd = skip_socket(SOCK_STREAM);
+	cfd = skip_socket(SOCK_STREAM);
+	set_port(&ss[0], port + 1);
+	if (sfd < 0 || cfd < 0 ||
+	    bind(sfd, (struct sockaddr *)&ss[0], len[0]) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+	set_port(&ss[0], 0);
+	if (bind(cfd, (struct sockaddr *)&ss[0], len[0]) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+	ret |= expect("policy inbound listen", listen(sfd, 8), 0);
+	ret |= expect("policy inbound connect",
+		      connect(cfd, (struct sockaddr *)&ss[2], len[2]), EPERM);
+	close(cfd);
+	close(sfd);
+
+	/* outbound only: connect() and no listen() */
+	sfd = skip_socket(SOCK_STREAM);
+	cfd = skip_socket(SOCK_STREAM);
+	set_port(&ss[1], port + 1);
+	if (sfd < 0 || cfd < 0 ||
+	    bind(sfd, (struct sockaddr *)&ss[1], len[1]) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+	set_port(&ss[1], 0);
+	if (bind(cfd, (struct sockaddr *)&ss[1], len[1]) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+	ret |= expect("policy outbound listen", listen(sfd, 8), EPERM);
+	ret |= expect("policy outbound connect",
+		      connect(cfd, (struct sockaddr *)&ss[2], len[2]), 0);
+	afd = wait_readable(lfd) ? -1 : accept(lfd, NULL, NULL);
+	if (afd >= 0)
+		close(afd);
+	close(cfd);
+	close(sfd);
+	close(lfd);
+
+	/* a wildcard bind is on the host address of inbound routes */
+	memset(&any, 0, sizeof(any));
+	any.sin_family = AF_INET;
+	any.sin_port = htons(port + 2);
+	sfd = skip_socket(SOCK_STREAM);
+	if (sfd < 0 || bind(sfd, (struct sockaddr *)&any, sizeof(any)) < 0 ||
+	    listen(sfd, 8) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+	for (n = 2; n < 4; n++) {
+		set_port(&ss[n], port + 2);
+		cfd = peer_socket(ss[n].ss_family, SOCK_STREAM);
+		if (cfd < 0)
+			return FAIL;
+		ret |= expect(n == 2 ? "policy wildcard on inbound" :
+			      "policy wildcard not on outbound",
+			      connect(cfd, (struct sockaddr *)&ss[n], len[n]),
+			      n == 2 ? 0 : ECONNREFUSED);
+		close(cfd);
+	}
+	close(sfd);
+
+	return ret;
+}
+
+#define SRCS_CONNS	16
+#define SRCS_MAX	8
+
+static int test_srcs(int argc, char **argv)
+{
+	int n, i, lfd, afd, nsrcs, nused = 0, named = 1, ret = PASS;
+	int cfd[SRCS_CONNS], used[SRCS_MAX] = { 0 };
+	char name[64];
+	socklen_t len, dlen, alen;
+	struct sockaddr_storage ss, dst, src, name_s;
+	struct sockaddr_in any, *sin = (struct sockaddr_in *)&src;
+	struct in_addr srcs[SRCS_MAX];
+
+	if (argc < 2 || parse_addr(argv[0], 0, &ss, &len) < 0 ||
+	    ss.ss_family != AF_INET) {
+		usage();
+		return FAIL;
+	}
+	for (nsrcs = 0; nsrcs < argc - 1 && nsrcs < SRCS_MAX; nsrcs++) {
+		if (inet_pton(AF_INET, argv[nsrcs + 1], &srcs[nsrcs]) != 1) {
+			usage();
+			return FAIL;
+		}
+	}
+
+	/* connect() to the first pool address */
+	if (parse_addr(argv[1], port, &dst, &dlen) < 0)
+		return FAIL;
+
+	memset(&any, 0, sizeof(any));
+	any.sin_family = AF_INET;
+	any.sin_port = htons(port);
+	lfd = peer_socket(AF_INET, SOCK_STREAM);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&any, sizeof(any)) < 0 ||
+	    listen(lfd, SRCS_CONNS) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+
+	/* the pool address is picked by the flow of each socket */
+	for (n = 0; n < SRCS_CONNS; n++) {
+		cfd[n] = skip_socket(SOCK_STREAM);
+		if (cfd[n] < 0 ||
+		    bind(cfd[n], (struct sockaddr *)&ss, len) < 0 ||
+		    connect(cfd[n], (struct sockaddr *)&dst, dlen) < 0) {
+			perror("bind/connect");
+			return FAIL;
+		}
+
+		alen = sizeof(name_s);
+		if (getsockname(cfd[n], (struct sockaddr *)&name_s, &alen) ||
+		    ((struct sockaddr_in *)&name_s)->sin_addr.s_addr !=
+		    ((struct sockaddr_in *)&ss)->sin_addr.s_addr)
+			named = 0;
+
+		alen = sizeof(src);
+		afd = wait_readable(lfd) ? -1 :
+			accept(lfd, (struct sockaddr *)&src, &alen);
+		if (afd < 0) {
+			perror("accept");
+			return FAIL;
+		}
+		close(afd);
+
+		for (i = 0; i < nsrcs; i++)
+			if (srcs[i].s_addr == sin->sin_addr.s_addr)
+				break;
+		if (i == nsrcs) {
+			printf("source %s is not of the pool\n",
+			       inet_ntoa(sin->sin_addr));
+			ret = FAIL;
+		} else if (!used[i]++)
+			nused++;
+	}
+
+	ret |= result("srcs getsockname", named);
+	snprintf(name, sizeof(name), "srcs %d of %d addresses used",
+		 nused, nsrcs);
+	ret |= result(name, nused > 1);
+
+	for (n = 0; n < SRCS_CONNS; n++)
+		close(cfd[n]);
+	close(lfd);
+
+	return ret;
+}
+
+static int test_connect(int argc, char **argv)
+{
+	int lfd, ufd, cfd, afd, ret = PASS;
+	char buf[16];
+	socklen_t len, alen;
+	struct sockaddr_storage ss, name, peer;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&name;
+
+	if (argc < 3 || parse_addr(argv[0], port, &ss, &len) < 0) {
+		usage();
+		return FAIL;
+	}
+
+	lfd = peer_socket(ss.ss_family, SOCK_STREAM);
+	ufd = peer_socket(ss.ss_family, SOCK_DGRAM);
+	if (lfd < 0 || ufd < 0 ||
+	    bind(lfd, (struct sockaddr *)&ss, len) < 0 ||
+	    listen(lfd, 8) < 0 ||
+	    bind(ufd, (struct sockaddr *)&ss, len) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+
+	/* the port is chosen by connect() of the host socket, and
+	 * the source address is that of the netns */
+	cfd = skip_socket(SOCK_STREAM);
+	if (cfd < 0)
+		return FAIL;
+	ret |= expect("connect unbound",
+		      connect(cfd, (struct sockaddr *)&ss, len), 0);
+	alen = sizeof(name);
+	getsockname(cfd, (struct sockaddr *)&name, &alen);
+	alen = sizeof(peer);
+	afd = wait_readable(lfd) ? -1 :
+		accept(lfd, (struct sockaddr *)&peer, &alen);
+	ret |= result("connect unbound name", afd >= 0 &&
+		      name.ss_family == AF_INET && sin->sin_port &&
+		      sin->sin_port == ((struct sockaddr_in *)&peer)->sin_port);
+	if (afd >= 0)
+		close(afd);
+	close(cfd);
+
+	cfd = skip_socket(SOCK_DGRAM);
+	if (cfd < 0)
+		return FAIL;
+	ret |= expect("sendto unbound",
+		      sendto(cfd, "x", 1, 0, (struct sockaddr *)&ss, len), 0);
+	alen = sizeof(name);
+	getsockname(cfd, (struct sockaddr *)&name, &alen);
+	alen = sizeof(peer);
+	ret |= result("sendto unbound name", !wait_readable(ufd) &&
+		      recvfrom(ufd, buf, sizeof(buf), 0,
+			       (struct sockaddr *)&peer, &alen) == 1 &&
+		      sin->sin_port &&
+		      sin->sin_port == ((struct sockaddr_in *)&peer)->sin_port);
+	close(cfd);
+
+	if (parse_addr(argv[1], port, &ss, &len) < 0)
+		return FAIL;
+	cfd = skip_socket(SOCK_STREAM);
+	if (cfd < 0)
+		return FAIL;
+	ret |= expect("connect source not outbound",
+		      connect(cfd, (struct sockaddr *)&ss, len), EPERM);
+	close(cfd);
+
+	if (parse_addr(argv[2], port, &ss, &len) < 0)
+		return FAIL;
+	cfd = skip_socket(SOCK_STREAM);
+	if (cfd < 0)
+		return FAIL;
+	ret |= expect("connect source off route",
+		      connect(cfd, (struct sockaddr *)&ss, len), ENONET);
+	close(cfd);
+
+	close(ufd);
+	close(lfd);
+
+	return ret;
+}
+
+static int test_netns(int argc, char **argv)
+{
+	int lfd, sfd, cfd, afd, ret = PASS;
+	socklen_t len, hlen;
+	struct sockaddr_storage ss, host;
+
+	if (argc < 2 || parse_addr(argv[0], port, &ss, &len) < 0 ||
+	    parse_addr(argv[1], port, &host, &hlen) < 0) {
+		usage();
+		return FAIL;
+	}
+
+	sfd = skip_socket(SOCK_STREAM);
+	if (sfd < 0 || bind(sfd, (struct sockaddr *)&ss, len) < 0 ||
+	    listen(sfd, 8) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+
+	cfd = peer_socket(host.ss_family, SOCK_STREAM);
+	if (cfd < 0)
+		return FAIL;
+	ret |= expect("netns connect from host netns",
+		      connect(cfd, (struct sockaddr *)&host, hlen), 0);
+	afd = wait_readable(sfd) ? -1 : accept(sfd, NULL, NULL);
+	ret |= result("netns accept", afd >= 0);
+	if (afd >= 0)
+		close(afd);
+	close(cfd);
+
+	cfd = netns_socket(selfns, host.ss_family, SOCK_STREAM);
+	if (cfd < 0)
+		return FAIL;
+	ret |= expect("netns connect from other netns",
+		      connect(cfd, (struct sockaddr *)&host, hlen),
+		      ECONNREFUSED);
+	close(cfd);
+	close(sfd);
+
+	/* and a client reaches a listener of the host netns */
+	set_port(&host, port + 1);
+	lfd = peer_socket(host.ss_family, SOCK_STREAM);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&host, hlen) < 0 ||
+	    listen(lfd, 8) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+	set_port(&ss, 0);
+	cfd = skip_socket(SOCK_STREAM);
+	if (cfd < 0 || bind(cfd, (struct sockaddr *)&ss, len) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+	ret |= expect("netns connect to host netns",
+		      connect(cfd, (struct sockaddr *)&host, hlen), 0);
+	close(cfd);
+	close(lfd);
+
+	return ret;
+}
+
+static int connect_pair(struct sockaddr_storage *ss, socklen_t len,
+			struct sockaddr_storage *host, socklen_t hlen,
+			int *lfd, int *cfd, int *afd)
+{
+	/* a native listener on host, and an AF_SKIP client bound to
+	 * ss connected to it */
+
+	*lfd = peer_socket(host->ss_family, SOCK_STREAM);
+	if (*lfd < 0 || bind(*lfd, (struct sockaddr *)host, hlen) < 0 ||
+	    listen(*lfd, 8) < 0) {
+		perror("bind/listen");
+		return -1;
+	}
+
+	*cfd = skip_socket(SOCK_STREAM);
+	if (*cfd < 0 || bind(*cfd, (struct sockaddr *)ss, len) < 0 ||
+	    connect(*cfd, (struct sockaddr *)host, hlen) < 0) {
+		perror("bind/connect");
+		return -1;
+	}
+
+	*afd = wait_readable(*lfd) ? -1 : accept(*lfd, NULL, NULL);
+	if (*afd < 0) {
+		perror("accept");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int test_reval(int argc, char **argv)
+{
+	int sfd, lfd, cfd, afd, ret = PASS;
+	char buf[16];
+	socklen_t len, hlen, nlen;
+	struct sockaddr_storage ss, host, newhost;
+
+	if (argc < 3 || parse_addr(argv[0], port, &ss, &len) < 0 ||
+	    parse_addr(argv[1], port + 1, &host, &hlen) < 0 ||
+	    parse_addr(argv[2], port + 2, &newhost, &nlen) < 0) {
+		usage();
+		return FAIL;
+	}
+
+	sfd = skip_socket(SOCK_STREAM);
+	if (sfd < 0 || bind(sfd, (struct sockaddr *)&ss, len) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+
+	set_port(&ss, 0);
+	if (connect_pair(&ss, len, &host, hlen, &lfd, &cfd, &afd) < 0)
+		return FAIL;
+
+	if (run_cmd() < 0)
+		return FAIL;
+
+	ret |= expect("reval listen on old route", listen(sfd, 8), ENONET);
+	close(sfd);
+
+	ret |= expect("reval send on old connection",
+		      send(cfd, "x", 1, 0), 0);
+	ret |= result("reval recv on old connection", !wait_readable(afd) &&
+		      recv(afd, buf, sizeof(buf), 0) == 1);
+	close(afd);
+	close(cfd);
+	close(lfd);
+
+	/* bound to the host address of the new route */
+	set_port(&ss, port + 2);
+	sfd = skip_socket(SOCK_STREAM);
+	if (sfd < 0 || bind(sfd, (struct sockaddr *)&ss, len) < 0 ||
+	    listen(sfd, 8) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+	cfd = peer_socket(newhost.ss_family, SOCK_STREAM);
+	if (cfd < 0)
+		return FAIL;
+	ret |= expect("reval connect to new host",
+		      connect(cfd, (struct sockaddr *)&newhost, nlen), 0);
+	close(cfd);
+	close(sfd);
+
+	return ret;
+}
+
+static int test_reset(int argc, char **argv)
+{
+	int lfd, cfd, afd, ret = PASS;
+	char buf[16];
+	socklen_t len, hlen;
+	struct sockaddr_storage ss, host;
+
+	if (argc < 2 || parse_addr(argv[0], 0, &ss, &len) < 0 ||
+	    parse_addr(argv[1], port, &host, &hlen) < 0) {
+		usage();
+		return FAIL;
+	}
+
+	if (connect_pair(&ss, len, &host, hlen, &lfd, &cfd, &afd) < 0)
+		return FAIL;
+
+	if (run_cmd() < 0)
+		return FAIL;
+
+	/* aborted by a work after the route is gone */
+	wait_readable(cfd);
+	ret |= expect("reset connection aborted",
+		      recv(cfd, buf, sizeof(buf), MSG_DONTWAIT),
+		      ECONNABORTED);
+
+	close(afd);
+	close(cfd);
+	close(lfd);
+
+	return ret;
+}
+
+static int test_packet(int argc, char **argv)
+{
+	int rfd, sfd, ret = PASS;
+	char buf[16];
+	socklen_t len;
+	struct sockaddr_storage ss;
+
+	if (argc < 1 || parse_addr(argv[0], port, &ss, &len) < 0) {
+		usage();
+		return FAIL;
+	}
+
+	rfd = peer_socket(ss.ss_family, SOCK_DGRAM);
+	sfd = netns_socket(skipns, ss.ss_family, SOCK_DGRAM);
+	if (rfd < 0 || sfd < 0 ||
+	    bind(rfd, (struct sockaddr *)&ss, len) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+
+	/* not translated, DEST is routed in the netns of -N */
+	ret |= expect("packet sendto",
+		      sendto(sfd, "x", 1, 0, (struct sockaddr *)&ss, len), 0);
+	ret |= result("packet recv", !wait_readable(rfd) &&
+		      recv(rfd, buf, sizeof(buf), 0) == 1);
+
+	close(sfd);
+	close(rfd);
+
+	return ret;
+}
+
+static int test_dcache(int argc, char **argv)
+{
+	int n, rfd, sfd, count = 0, ret = PASS;
+	char buf[16];
+	socklen_t len, rlen, olen;
+	struct sockaddr_storage ss, reject, offroute;
+
+	if (argc < 3 || parse_addr(argv[0], port, &ss, &len) < 0 ||
+	    parse_addr(argv[1], port, &reject, &rlen) < 0 ||
+	    parse_addr(argv[2], port, &offroute, &olen) < 0) {
+		usage();
+		return FAIL;
+	}
+
+	rfd = peer_socket(ss.ss_family, SOCK_DGRAM);
+	if (rfd < 0 || bind(rfd, (struct sockaddr *)&ss, len) < 0) {
+		perror("bind");
+		return FAIL;
+	}
+
+	/* no host socket to send from off the skip routes */
+	sfd = skip_socket(SOCK_DGRAM);
+	if (sfd < 0)
+		return FAIL;
+	ret |= expect("dcache unbound to off route",
+		      sendto(sfd, "x", 1, 0, (struct sockaddr *)&offroute,
+			     olen), EADDRNOTAVAIL);
+	close(sfd);
+
+	/* the verdicts are cached per destination after the first */
+	sfd = skip_socket(SOCK_DGRAM);
+	if (sfd < 0)
+		return FAIL;
+	for (n = 0; n < 2; n++) {
+		ret |= expect("dcache to on route",
+			      sendto(sfd, "x", 1, 0, (struct sockaddr *)&ss,
+				     len), 0);
+		ret |= expect("dcache to rejected",
+			      sendto(sfd, "x", 1, 0,
+				     (struct sockaddr *)&reject, rlen), EPERM);
+		ret |= expect("dcache to off route",
+			      sendto(sfd, "x", 1, 0,
+				     (struct sockaddr *)&offroute, olen),
+			      EADDRNOTAVAIL);
+	}
+	while (!wait_readable(rfd) && recv(rfd, buf, sizeof(buf), 0) == 1)
+		if (++count == n)
+			break;
+	ret |= result("dcache recv on route", count == n);
+
+	/* and are dropped by a route change */
+	if (run_cmd() < 0)
+		return FAIL;
+	ret |= expect("dcache to deleted route",
+		      sendto(sfd, "x", 1, 0, (struct sockaddr *)&ss, len),
+		      EADDRNOTAVAIL);
+
+	close(sfd);
+	close(rfd);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, ret;
+	char *test, *skipname = NULL, *peername = "/proc/self/ns/net";
+
+	while ((ch = getopt(argc, argv, "p:n:N:c:h")) != -1) {
+		switch (ch) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'n':
+			skipname = optarg;
+			break;
+		case 'N':
+			peername = optarg;
+			break;
+		case 'c':
+			cmd = optarg;
+			break;
+		default:
+			usage();
+			return FAIL;
+		}
+	}
+
+	if (!skipname || optind >= argc) {
+		usage();
+		return FAIL;
+	}
+	test = argv[optind];
+
+	selfns = netns_open("/proc/self/ns/net");
+	skipns = netns_open(skipname);
+	peerns = netns_open(peername);
+	if (selfns < 0 || skipns < 0 || peerns < 0)
+		return FAIL;
+
+	argc -= optind + 1;
+	argv += optind + 1;
+
+	if (strcmp(test, "wildcard") == 0)
+		ret = test_wildcard(argc, argv);
+	else if (strcmp(test, "v4v6") == 0)
+		ret = test_v4v6(argc, argv);
+	else if (strcmp(test, "policy") == 0)
+		ret = test_policy(argc, argv);
+	else if (strcmp(test, "srcs") == 0)
+		ret = test_srcs(argc, argv);
+	else if (strcmp(test, "connect") == 0)
+		ret = test_connect(argc, argv);
+	else if (strcmp(test, "netns") == 0)
+		ret = test_netns(argc, argv);
+	else if (strcmp(test, "reval") == 0)
+		ret = test_reval(argc, argv);
+	else if (strcmp(test, "reset") == 0)
+		ret = test_reset(argc, argv);
+	else if (strcmp(test, "packet") == 0)
+		ret = test_packet(argc, argv);
+	else if (strcmp(test, "dcache") == 0)
+		ret = test_dcache(argc, argv);
+	else {
+		usage();
+		return FAIL;
+	}
+
+	printf("%s: %s\n", test, ret == PASS ? "PASS" : "FAIL");
+
+	return ret;
+}
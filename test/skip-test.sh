@@ -0,0 +1,115 @@
+#!/bin/bash
+#
+# behaviour tests of AF_SKIP sockets. Each case runs in a netns of
+# its own, with the skip routes it needs. Run with the skip module
+# loaded.
+
+. ./common.sh
+
+test=./skip-test
+nsname=skip-test
+hostns=skip-test-host
+reset_stale=/sys/module/skip/parameters/reset_stale
+port=10000
+fail=0
+
+make -s skip-test || exit 1
+
+sources() {
+	# sources NAME: the netns chooses 127.0.0.1, on a skip route,
+	# toward 127.0.0.1, 172.16.2.1, on an inbound only skip route,
+	# toward 10.2.0.0/16, and 172.16.3.1, on no skip route, toward
+	# 10.3.0.0/16
+	netns_add $1
+	$ip -n $1 addr add 172.16.2.1/32 dev lo
+	$ip -n $1 addr add 172.16.3.1/32 dev lo
+	$ip -n $1 route add to 10.2.0.0/16 dev lo src 172.16.2.1
+	$ip -n $1 route add to 10.3.0.0/16 dev lo src 172.16.3.1
+	skip_route $1 127.0.0.0/8 127.0.0.1
+	skip_route $1 172.16.2.0/24 127.0.0.1 inbound
+}
+
+run() {
+	# run [-N NETNS] [-c CMD] CASE [ADDRESS...]: run a case on the
+	# routes of $nsname, and delete the netns
+	$test -p $port -n $nsname "$@"
+	[ $? -ne 0 ] && fail=1
+	port=$((port + 10))
+	netns_del $nsname
+}
+
+
+# wildcard bind fans in the host addresses of the inbound routes
+netns_add $nsname
+skip_route $nsname 172.16.0.0/16 127.0.0.1
+skip_route $nsname 172.17.0.0/16 127.0.0.2
+run wildcard 127.0.0.1 127.0.0.2
+
+# IPv4 sockets over IPv6 host sockets. The host reaches the v4-mapped
+# addresses of the prefix over IPv4.
+netns_add $nsname
+skip_route $nsname 127.0.0.0/8 :: inbound outbound map ::ffff:0.0.0.0
+run v4v6 127.0.0.1
+
+# inbound only and outbound only routes
+netns_add $nsname
+skip_route $nsname 172.16.1.0/24 127.0.0.1 inbound
+skip_route $nsname 172.16.2.0/24 127.0.0.2 outbound
+run policy 172.16.1.1 172.16.2.1 127.0.0.1 127.0.0.2
+
+# source address pool
+netns_add $nsname
+skip_route $nsname 172.16.0.0/16 127.0.0.1,127.0.0.2,127.0.0.3,127.0.0.4
+run srcs 172.16.0.1 127.0.0.1 127.0.0.2 127.0.0.3 127.0.0.4
+
+# unbound sockets are bound on connect() through the route of the
+# source address
+sources $nsname
+run connect 127.0.0.1 10.2.0.1 10.3.0.1
+
+# host sockets in another netns than init_net, by name and by nsid
+netns_add $hostns
+netns_add $nsname
+skip_route $nsname 172.16.0.0/16 127.0.0.1 inbound outbound netns $hostns
+run -N $hostns netns 172.16.0.1 127.0.0.1
+
+netns_add $nsname
+$ip -n $nsname netns set $hostns 5
+skip_route $nsname 172.16.0.0/16 127.0.0.1 inbound outbound netnsid 5
+run -N $hostns netns 172.16.0.1 127.0.0.1
+netns_del $hostns
+
+# sockets revalidate their route after a route change, and are
+# aborted when it is deleted with reset_stale
+netns_add $nsname
+skip_route $nsname 172.16.0.0/16 127.0.0.1
+run -c "$ip -n $nsname route replace to 172.16.0.0/16 dev lo \
+	encap skip host 127.0.0.2 inbound outbound" \
+	reval 172.16.0.1 127.0.0.1 127.0.0.2
+
+old=`cat $reset_stale`
+echo 1 > $reset_stale
+netns_add $nsname
+skip_route $nsname 172.16.0.0/16 127.0.0.1
+run -c "$ip -n $nsname route del to 172.16.0.0/16" \
+	reset 172.16.0.1 127.0.0.1
+echo $old > $reset_stale
+
+# packet mode redirects packets of the netns into the host netns
+netns_add $hostns
+$ip -n $hostns addr add 10.255.255.1/32 dev lo
+netns_add $nsname
+$ip -n $nsname addr add 10.255.0.1/32 dev lo
+$ip -n $nsname route add to 10.255.255.1/32 dev lo src 10.255.0.1 \
+	encap skip host 127.0.0.1 packet netns $hostns
+run -N $hostns packet 10.255.255.1
+netns_del $hostns
+
+# verdicts of unconnected sendto() per destination, cached until
+# the routes change
+sources $nsname
+run -c "$ip -n $nsname route del to 127.0.0.0/8" \
+	dcache 127.0.0.1 10.2.0.1 10.3.0.1
+
+
+exit $fail
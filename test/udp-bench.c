@@ -0,0 +1,302 @@
+/* udp-bench.c
+ *
+ * measure UDP packets per second of AF_SKIP (or native AF_INET/
+ * AF_INET6 for comparison) sockets, with sendmmsg()/recvmmsg()
+ * batches, segmentation offload (UDP_SEGMENT) on the sender and
+ * receive offload (UDP_GRO) on the receiver.
+ *
+ * server: udp-bench -s [-t] [-b batch] [-G] [-l len] [-p port] ADDRESS
+ * client: udp-bench -c [-t] [-b batch] [-g gso_size] [-l len]
+ *                   [-d sec] [-B BIND] [-p port] ADDRESS
+ *
+ * With -g, each message of len bytes is sent as datagrams of
+ * gso_size bytes. The server stops 1 sec after the last datagram.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+/* older headers */
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO		104
+#endif
+
+#define BATCH_MAX	256
+#define LEN_MAX		65507
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: udp-bench [-s|-c] [-t] [-b batch] [-g gso_size] [-G] "
+		"[-l len] [-d sec] [-B BIND] [-p port] ADDRESS\n"
+		"  -s          run as server (receive)\n"
+		"  -c          run as client (send)\n"
+		"  -t          use native AF_INET/AF_INET6 socket\n"
+		"  -b batch    messages per sendmmsg()/recvmmsg() "
+		"(default 1)\n"
+		"  -g size     client sends with UDP_SEGMENT of size\n"
+		"  -G          server receives with UDP_GRO\n"
+		"  -l len      message length (default 64)\n"
+		"  -d sec      duration in seconds (default 10)\n"
+		"  -B BIND     address the client binds before sending\n"
+		"  -p port     port number (default 10000)\n");
+}
+
+static char bufs[BATCH_MAX][LEN_MAX];
+static char cbufs[BATCH_MAX][CMSG_SPACE(sizeof(int))];
+static struct mmsghdr msgs[BATCH_MAX];
+static struct iovec iovs[BATCH_MAX];
+
+static void setup_msgs(int batch, size_t len, int control)
+{
+	int n;
+
+	memset(msgs, 0, sizeof(msgs));
+	for (n = 0; n < batch; n++) {
+		iovs[n].iov_base = bufs[n];
+		iovs[n].iov_len = len;
+		msgs[n].msg_hdr.msg_iov = &iovs[n];
+		msgs[n].msg_hdr.msg_iovlen = 1;
+		if (control) {
+			msgs[n].msg_hdr.msg_control = cbufs[n];
+			msgs[n].msg_hdr.msg_controllen = sizeof(cbufs[n]);
+		}
+	}
+}
+
+static unsigned int gro_segs(struct msghdr *m, unsigned int len)
+{
+	/* datagrams coalesced into one message by UDP_GRO */
+
+	struct cmsghdr *cmsg;
+	int gso_size;
+
+	for (cmsg = CMSG_FIRSTHDR(m); cmsg; cmsg = CMSG_NXTHDR(m, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP &&
+		    cmsg->cmsg_type == UDP_GRO) {
+			memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+			if (gso_size > 0)
+				return (len + gso_size - 1) / gso_size;
+		}
+	}
+
+	return 1;
+}
+
+static int server(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  int native, int batch, int gro, size_t len)
+{
+	int fd, n, ret, on = 1, started = 0;
+	unsigned long long pkts = 0, msgcnt = 0, bytes = 0;
+	struct timeval tv = { .tv_sec = 1 };
+	struct timespec start, end;
+	double sec;
+
+	fd = socket(native ? saddr_s->ss_family : AF_SKIP, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)
+		perror("setsockopt");
+
+	if (gro && setsockopt(fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) < 0) {
+		perror("setsockopt(UDP_GRO)");
+		return -1;
+	}
+
+	if (bind(fd, (struct sockaddr *)saddr_s, addrlen) < 0) {
+		perror("bind");
+		return -1;
+	}
+
+	/* GRO makes a message of up to 64KB */
+	setup_msgs(batch, gro ? LEN_MAX : len, gro);
+
+	for (;;) {
+		for (n = 0; n < batch && gro; n++)
+			msgs[n].msg_hdr.msg_controllen = sizeof(cbufs[n]);
+
+		ret = recvmmsg(fd, msgs, batch, MSG_WAITFORONE, NULL);
+		if (ret < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				perror("recvmmsg");
+			break;
+		}
+
+		if (!started) {
+			/* timeout for the end of the traffic */
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv,
+				   sizeof(tv));
+			started = 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		for (n = 0; n < ret; n++) {
+			pkts += gro ? gro_segs(&msgs[n].msg_hdr,
+					       msgs[n].msg_len) : 1;
+			bytes += msgs[n].msg_len;
+		}
+		msgcnt += ret;
+	}
+
+	sec = started ? elapsed(&start, &end) : 0;
+
+	printf("%s recv: %llu packets in %llu messages, %.3f sec, "
+	       "%.0f pps, %.2f Gbit/s\n", native ? "native" : "skip",
+	       pkts, msgcnt, sec, sec ? pkts / sec : 0,
+	       sec ? bytes * 8 / sec / 1000000000.0 : 0);
+
+	close(fd);
+
+	return 0;
+}
+
+static int client(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  struct sockaddr_storage *baddr_s, socklen_t baddrlen,
+		  int native, int batch, int gso, size_t len, int duration)
+{
+	int fd, ret;
+	unsigned long long pkts = 0, msgcnt = 0, segs;
+	struct timespec start, now;
+	double sec;
+
+	fd = socket(native ? saddr_s->ss_family : AF_SKIP, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (gso && setsockopt(fd, SOL_UDP, UDP_SEGMENT, &gso,
+			      sizeof(gso)) < 0) {
+		perror("setsockopt(UDP_SEGMENT)");
+		return -1;
+	}
+
+	if (baddrlen && bind(fd, (struct sockaddr *)baddr_s, baddrlen) < 0) {
+		perror("bind");
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr *)saddr_s, addrlen) < 0) {
+		perror("connect");
+		return -1;
+	}
+
+	setup_msgs(batch, len, 0);
+	segs = gso ? (len + gso - 1) / gso : 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	do {
+		ret = sendmmsg(fd, msgs, batch, 0);
+		if (ret < 0) {
+			/* the receiver may not be ready */
+			if (errno != ECONNREFUSED) {
+				perror("sendmmsg");
+				break;
+			}
+			ret = 0;
+		}
+		msgcnt += ret;
+		pkts += ret * segs;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (elapsed(&start, &now) < duration);
+
+	sec = elapsed(&start, &now);
+
+	printf("%s send: %llu packets in %llu messages, %.3f sec, "
+	       "%.0f pps\n", native ? "native" : "skip", pkts, msgcnt,
+	       sec, sec ? pkts / sec : 0);
+
+	close(fd);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, port = 10000, native = 0, role = 0, batch = 1;
+	int gso = 0, gro = 0, duration = 10;
+	size_t len = 64;
+	char *bind_addr = NULL;
+	socklen_t addrlen, baddrlen = 0;
+	struct sockaddr_storage saddr_s, baddr_s;
+
+	while ((ch = getopt(argc, argv, "sctb:g:Gl:d:B:p:h")) != -1) {
+		switch (ch) {
+		case 's':
+		case 'c':
+			role = ch;
+			break;
+		case 't':
+			native = 1;
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'g':
+			gso = atoi(optarg);
+			break;
+		case 'G':
+			gro = 1;
+			break;
+		case 'l':
+			len = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'B':
+			bind_addr = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (!role || optind >= argc || batch < 1 || batch > BATCH_MAX ||
+	    !len || len > LEN_MAX || gso < 0) {
+		usage();
+		return -1;
+	}
+
+	if (parse_addr(argv[optind], port, &saddr_s, &addrlen) < 0)
+		return -1;
+	if (bind_addr && parse_addr(bind_addr, 0, &baddr_s, &baddrlen) < 0)
+		return -1;
+
+	if (role == 's')
+		return server(&saddr_s, addrlen, native, batch, gro, len);
+
+	return client(&saddr_s, addrlen, &baddr_s, baddrlen, native, batch,
+		      gso, len, duration);
+}
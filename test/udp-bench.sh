@@ -0,0 +1,63 @@
+#!/bin/bash
+#
+# UDP packets per second between two netns: native sockets over
+# veth, and AF_SKIP sockets in each netns over the host loopback,
+# against native sockets on the host. Each case is run with single
+# sendmsg()/recvmsg(), with sendmmsg()/recvmmsg() batches, and with
+# UDP_SEGMENT/UDP_GRO on top of the batches (linux 5.0 or later).
+
+. ./common.sh
+
+bench=./udp-bench
+nsa=skip-bench-a
+nsb=skip-bench-b
+duration=${DURATION:-10}
+port=10000
+
+make -s udp-bench || exit 1
+
+# setup test namespaces, connected by veth for the native case
+for ns in $nsa $nsb; do
+	netns_add $ns
+	skip_route $ns 172.16.0.0/16 127.0.0.1
+done
+$ip link add skip-veth-a netns $nsa type veth peer name skip-veth-b \
+	netns $nsb
+$ip -n $nsa addr add 10.255.0.1/24 dev skip-veth-a
+$ip -n $nsb addr add 10.255.0.2/24 dev skip-veth-b
+$ip -n $nsa link set skip-veth-a up
+$ip -n $nsb link set skip-veth-b up
+
+run() {
+	# run NAME SERVER SERVER_OPTS SERVER_ADDR CLIENT CLIENT_OPTS
+	#     CLIENT_ADDR
+	echo udp-bench: $1
+	$2 $bench -s $3 -p $port $4 &
+	sleep 0.5
+	$5 $bench -c $6 -d $duration -p $port $7
+	wait
+	port=$((port + 1))
+	echo
+}
+
+nsexeca="$ip netns exec $nsa"
+nsexecb="$ip netns exec $nsb"
+
+for opts in "-b 1" "-b 64" "-b 64 gso"; do
+	sopts=${opts% gso}
+	copts=$sopts
+	if [ "$opts" != "$sopts" ]; then
+		sopts="$sopts -G"
+		copts="$copts -g 1200 -l 12000"
+	fi
+
+	run "native on host, $opts" "" "-t $sopts" 127.0.0.1 \
+		"" "-t $copts" 127.0.0.1
+	run "native over veth, $opts" "$nsexeca" "-t $sopts" 10.255.0.1 \
+		"$nsexecb" "-t $copts" 10.255.0.1
+	run "skip, $opts" "$nsexeca" "$sopts" 172.16.0.1 \
+		"$nsexecb" "-B 172.16.0.2 $copts" 127.0.0.1
+done
+
+
+netns_del $nsa $nsb
@@ -0,0 +1,270 @@
+/* ulp-test.c
+ *
+ * check in-kernel consumers of sockets work on AF_SKIP sockets (or
+ * native AF_INET/AF_INET6 for comparison). A listener and a client
+ * are opened in the same process and connected.
+ *
+ *   ktls: the client sends with TLS_TX of kernel TLS. The listener
+ *         reads the raw TLS record.
+ *   kcm:  the accepted socket is attached to a KCM mux with a BPF
+ *         parser of 4 bytes length headers (strparser, read_sock).
+ *
+ * usage: ulp-test [-t] [-p port] ktls|kcm ADDRESS [DEST]
+ *
+ * exit status: 0 pass, 1 fail, 2 not supported by the kernel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/kcm.h>
+#include <linux/tls.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+/* older headers */
+#ifndef TCP_ULP
+#define TCP_ULP		31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS		282
+#endif
+#ifndef AF_KCM
+#define AF_KCM		41
+#endif
+
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: ulp-test [-t] [-p port] ktls|kcm ADDRESS [DEST]\n"
+		"  -t          use native AF_INET/AF_INET6 sockets\n"
+		"  -p port     port number (default 10000)\n"
+		"  ADDRESS     address the listener binds\n"
+		"  DEST        address the client connects to "
+		"(default ADDRESS)\n");
+}
+
+static int unsupported(int err)
+{
+	return err == ENOPROTOOPT || err == ENOENT || err == EOPNOTSUPP ||
+		err == EAFNOSUPPORT || err == EPROTONOSUPPORT;
+}
+
+static int test_ktls(int cfd, int afd)
+{
+	/* a record of 5 bytes: header 5, explicit nonce 8, tag 16 */
+
+	char buf[64];
+	ssize_t ret, len = 0;
+	struct tls12_crypto_info_aes_gcm_128 ci;
+
+	if (setsockopt(cfd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+		perror("setsockopt(TCP_ULP)");
+		return unsupported(errno) ? UNSUPP : FAIL;
+	}
+
+	memset(&ci, 0, sizeof(ci));
+	ci.info.version = TLS_1_2_VERSION;
+	ci.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+	if (setsockopt(cfd, SOL_TLS, TLS_TX, &ci, sizeof(ci)) < 0) {
+		perror("setsockopt(TLS_TX)");
+		return unsupported(errno) ? UNSUPP : FAIL;
+	}
+
+	if (send(cfd, "hello", 5, 0) != 5) {
+		perror("send");
+		return FAIL;
+	}
+
+	while (len < 5 + 8 + 5 + 16) {
+		ret = read(afd, buf + len, sizeof(buf) - len);
+		if (ret <= 0) {
+			perror("read");
+			return FAIL;
+		}
+		len += ret;
+	}
+
+	if (len != 5 + 8 + 5 + 16 || buf[0] != 0x17 ||
+	    buf[1] != 0x03 || buf[2] != 0x03 ||
+	    ((buf[3] & 0xff) << 8 | (buf[4] & 0xff)) != 8 + 5 + 16) {
+		fprintf(stderr, "unexpected record, %zd bytes\n", len);
+		return FAIL;
+	}
+
+	return PASS;
+}
+
+static int bpf_parser(void)
+{
+	/* r0 = ntohl(*(u32 *)skb->data) + 4 */
+
+	struct bpf_insn insns[] = {
+		{ .code = BPF_ALU64 | BPF_MOV | BPF_X,
+		  .dst_reg = BPF_REG_6, .src_reg = BPF_REG_1 },
+		{ .code = BPF_LD | BPF_ABS | BPF_W, .imm = 0 },
+		{ .code = BPF_ALU64 | BPF_ADD | BPF_K,
+		  .dst_reg = BPF_REG_0, .imm = 4 },
+		{ .code = BPF_JMP | BPF_EXIT },
+	};
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+	attr.insns = (uintptr_t)insns;
+	attr.insn_cnt = sizeof(insns) / sizeof(insns[0]);
+	attr.license = (uintptr_t)"GPL";
+
+	return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+}
+
+static int test_kcm(int cfd, int afd)
+{
+	int kfd, pfd, n;
+	char msg[4 + 16], buf[64];
+	uint32_t hdr = htonl(16);
+	ssize_t ret;
+	struct kcm_attach attach;
+
+	kfd = socket(AF_KCM, SOCK_DGRAM, KCMPROTO_CONNECTED);
+	if (kfd < 0) {
+		perror("socket(AF_KCM)");
+		return unsupported(errno) ? UNSUPP : FAIL;
+	}
+
+	pfd = bpf_parser();
+	if (pfd < 0) {
+		perror("bpf(BPF_PROG_LOAD)");
+		return FAIL;
+	}
+
+	attach.fd = afd;
+	attach.bpf_fd = pfd;
+	if (ioctl(kfd, SIOCKCMATTACH, &attach) < 0) {
+		perror("ioctl(SIOCKCMATTACH)");
+		return FAIL;
+	}
+
+	memcpy(msg, &hdr, sizeof(hdr));
+	memset(msg + 4, 'x', 16);
+
+	/* the messages may arrive in one segment or split */
+	for (n = 0; n < 3; n++) {
+		if (send(cfd, msg, sizeof(msg), 0) != sizeof(msg)) {
+			perror("send");
+			return FAIL;
+		}
+	}
+
+	for (n = 0; n < 3; n++) {
+		ret = recv(kfd, buf, sizeof(buf), 0);
+		if (ret != sizeof(msg) || memcmp(buf, msg, sizeof(msg))) {
+			fprintf(stderr, "unexpected message %d, %zd bytes\n",
+				n, ret);
+			return FAIL;
+		}
+	}
+
+	close(pfd);
+	close(kfd);
+
+	return PASS;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, port = 10000, native = 0, on = 1, ret;
+	int lfd, cfd, afd;
+	char *test;
+	socklen_t addrlen, destlen;
+	struct sockaddr_storage saddr_s, daddr_s;
+
+	while ((ch = getopt(argc, argv, "tp:h")) != -1) {
+		switch (ch) {
+		case 't':
+			native = 1;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage();
+			return FAIL;
+		}
+	}
+
+	if (optind + 1 >= argc) {
+		usage();
+		return FAIL;
+	}
+	test = argv[optind];
+
+	if (parse_addr(argv[optind + 1], port, &saddr_s, &addrlen) < 0 ||
+	    parse_addr(optind + 2 < argc ? argv[optind + 2] :
+		       argv[optind + 1], port, &daddr_s, &destlen) < 0)
+		return FAIL;
+
+	/* KCM waits forever if strparser is not woken up */
+	alarm(5);
+
+	lfd = socket(native ? saddr_s.ss_family : AF_SKIP, SOCK_STREAM, 0);
+	cfd = socket(native ? daddr_s.ss_family : AF_SKIP, SOCK_STREAM, 0);
+	if (lfd < 0 || cfd < 0) {
+		perror("socket");
+		return FAIL;
+	}
+
+	if (setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)
+		perror("setsockopt");
+
+	if (bind(lfd, (struct sockaddr *)&saddr_s, addrlen) < 0 ||
+	    listen(lfd, 1) < 0) {
+		perror("bind/listen");
+		return FAIL;
+	}
+
+	if (connect(cfd, (struct sockaddr *)&daddr_s, destlen) < 0) {
+		perror("connect");
+		return FAIL;
+	}
+
+	afd = accept(lfd, NULL, NULL);
+	if (afd < 0) {
+		perror("accept");
+		return FAIL;
+	}
+
+	if (strcmp(test, "ktls") == 0)
+		ret = test_ktls(cfd, afd);
+	else if (strcmp(test, "kcm") == 0)
+		ret = test_kcm(cfd, afd);
+	else {
+		usage();
+		return FAIL;
+	}
+
+	printf("%s %s: %s\n", test, native ? "native" : "skip",
+	       ret == PASS ? "PASS" : ret == UNSUPP ? "not supported" :
+	       "FAIL");
+
+	close(afd);
+	close(cfd);
+	close(lfd);
+
+	return ret;
+}
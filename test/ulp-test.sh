@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# in-kernel consumers of sockets (kTLS and KCM/strparser) on AF_SKIP
+# sockets in a netns, against native sockets on the host. The
+# listener and the client of each case are AF_SKIP sockets. Run with
+# the skip module loaded.
+
+. ./common.sh
+
+test=./ulp-test
+nsname=skip-test
+port=10000
+fail=0
+
+make -s ulp-test || exit 1
+
+# setup test namespace
+netns_add $nsname
+skip_route $nsname 0.0.0.0/0 127.0.0.1
+
+
+for t in ktls kcm; do
+	$test -t -p $port $t 127.0.0.1
+	port=$((port + 1))
+
+	$ip netns exec $nsname $test -p $port $t 172.16.0.1 127.0.0.1
+	[ $? -eq 1 ] && fail=1
+	port=$((port + 1))
+done
+
+
+netns_del $nsname
+
+exit $fail
@@ -0,0 +1,58 @@
+/* util.h
+ *
+ * helpers shared by the benchmarks and tests.
+ */
+
+#ifndef _SKIP_TEST_UTIL_H_
+#define _SKIP_TEST_UTIL_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+
+/* exit status of the tests */
+#define PASS		0
+#define FAIL		1
+#define UNSUPP		2
+
+static inline void set_port(struct sockaddr_storage *ss, int port)
+{
+	if (ss->ss_family == AF_INET)
+		((struct sockaddr_in *)ss)->sin_port = htons(port);
+	else
+		((struct sockaddr_in6 *)ss)->sin6_port = htons(port);
+}
+
+static inline int parse_addr(const char *str, int port,
+			     struct sockaddr_storage *ss, socklen_t *len)
+{
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)ss;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)ss;
+
+	memset(ss, 0, sizeof(*ss));
+	if (inet_pton(AF_INET, str, &sa4->sin_addr) == 1) {
+		sa4->sin_family = AF_INET;
+		*len = sizeof(*sa4);
+	} else if (inet_pton(AF_INET6, str, &sa6->sin6_addr) == 1) {
+		sa6->sin6_family = AF_INET6;
+		*len = sizeof(*sa6);
+	} else {
+		fprintf(stderr, "invalid address '%s'\n", str);
+		return -1;
+	}
+	set_port(ss, port);
+
+	return 0;
+}
+
+static inline double elapsed(struct timespec *s, struct timespec *e)
+{
+	return (e->tv_sec - s->tv_sec) +
+		(e->tv_nsec - s->tv_nsec) / 1000000000.0;
+}
+
+#endif /* _SKIP_TEST_UTIL_H_ */
@@ -0,0 +1,394 @@
+/* wakeup-bench.c
+ *
+ * count epoll wakeups per event over thousands of TCP connections of
+ * AF_SKIP (or native AF_INET/AF_INET6 for comparison) sockets.
+ *
+ * server: wakeup-bench -s [-t] [-e excl|et] [-T threads] [-n conns]
+ *                      [-p port] ADDRESS
+ * client: wakeup-bench -c [-t] [-n conns] [-m events] [-B BIND]
+ *                      [-p port] ADDRESS
+ *
+ * The client sends 1 byte on a random connection at a time and waits
+ * for the echo. The server waits with a thread per epoll instance,
+ * each having all the connections with EPOLLEXCLUSIVE (excl), or
+ * with a single epoll instance in edge-triggered mode (et). Ideally,
+ * every event is a single wakeup that finds data to read.
+ *
+ * The client adds the sockets to its epoll instance before connect(),
+ * so that wakeups queued before a socket is bound are checked as
+ * well. An echo not woken up within 1 sec is counted as missed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <af_skip.h>
+
+#include "util.h"
+
+
+/* older headers */
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE	(1U << 28)
+#endif
+
+#define MODE_EXCL	0
+#define MODE_ET		1
+
+#define THREADS_MAX	64
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wakeup-bench [-s|-c] [-t] [-e excl|et] [-T threads] "
+		"[-n conns] [-m events] [-B BIND] [-p port] ADDRESS\n"
+		"  -s          run as server (echo)\n"
+		"  -c          run as client\n"
+		"  -t          use native AF_INET/AF_INET6 socket\n"
+		"  -e mode     server epoll mode, excl (default) or et\n"
+		"  -T threads  server threads of excl (default 4)\n"
+		"  -n conns    number of connections (default 2000)\n"
+		"  -m events   number of events (default 100000)\n"
+		"  -B BIND     address the client binds before connect\n"
+		"  -p port     port number (default 10000)\n");
+}
+
+static void raise_nofile(int conns)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+		return;
+
+	if (rl.rlim_cur < conns + 64) {
+		rl.rlim_cur = conns + 64;
+		if (rl.rlim_max < rl.rlim_cur)
+			rl.rlim_max = rl.rlim_cur;
+		if (setrlimit(RLIMIT_NOFILE, &rl) < 0)
+			perror("setrlimit");
+	}
+}
+
+struct server_thread {
+	pthread_t	tid;
+	int		epfd;
+	unsigned long long wakeups;	/* epoll_wait() with events */
+	unsigned long long events;	/* bytes echoed */
+	unsigned long long spurious;	/* events without data */
+};
+
+static int nconns;
+static int closed;	/* connections closed by the client */
+
+static void *server_loop(void *arg)
+{
+	struct server_thread *st = arg;
+	struct epoll_event evs[64];
+	char buf[256];
+	int n, nev, ret, fd, hit;
+	ssize_t len;
+
+	while (__atomic_load_n(&closed, __ATOMIC_RELAXED) < nconns) {
+		nev = epoll_wait(st->epfd, evs, 64, 100);
+		if (nev < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+
+		/* wakeups only for EOF at the end are not counted */
+		for (hit = 0, n = 0; n < nev; n++) {
+			fd = evs[n].data.fd;
+			/* drain, edge-triggered needs it */
+			for (len = 0; ; ) {
+				ret = read(fd, buf, sizeof(buf));
+				if (ret <= 0)
+					break;
+				if (write(fd, buf, ret) != ret)
+					perror("write");
+				len += ret;
+			}
+			if (!ret) {
+				__atomic_add_fetch(&closed, 1,
+						   __ATOMIC_RELAXED);
+				close(fd);
+			}
+			if (len) {
+				st->events += len;
+				hit = 1;
+			} else if (ret) {
+				st->spurious++;
+				hit = 1;
+			}
+		}
+		st->wakeups += hit;
+	}
+
+	return NULL;
+}
+
+static int server(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  int native, int mode, int nthreads)
+{
+	int fd, cfd, n, t, on = 1;
+	unsigned long long wakeups = 0, events = 0, spurious = 0;
+	struct server_thread st[THREADS_MAX];
+	struct epoll_event ev;
+
+	if (mode == MODE_ET)
+		nthreads = 1;
+
+	fd = socket(native ? saddr_s->ss_family : AF_SKIP, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0)
+		perror("setsockopt");
+
+	if (bind(fd, (struct sockaddr *)saddr_s, addrlen) < 0) {
+		perror("bind");
+		return -1;
+	}
+
+	if (listen(fd, 4096) < 0) {
+		perror("listen");
+		return -1;
+	}
+
+	/* EPOLLEXCLUSIVE works on separate epoll instances */
+	for (t = 0; t < nthreads; t++) {
+		memset(&st[t], 0, sizeof(st[t]));
+		st[t].epfd = epoll_create1(0);
+		if (st[t].epfd < 0) {
+			perror("epoll_create1");
+			return -1;
+		}
+	}
+
+	for (n = 0; n < nconns; n++) {
+		cfd = accept(fd, NULL, NULL);
+		if (cfd < 0) {
+			perror("accept");
+			return -1;
+		}
+		setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+
+		ev.events = EPOLLIN | (mode == MODE_ET ? EPOLLET :
+				       EPOLLEXCLUSIVE);
+		ev.data.fd = cfd;
+		for (t = 0; t < nthreads; t++) {
+			if (epoll_ctl(st[t].epfd, EPOLL_CTL_ADD, cfd,
+				      &ev) < 0) {
+				perror("epoll_ctl");
+				return -1;
+			}
+		}
+	}
+
+	for (t = 0; t < nthreads; t++)
+		pthread_create(&st[t].tid, NULL, server_loop, &st[t]);
+
+	for (t = 0; t < nthreads; t++) {
+		pthread_join(st[t].tid, NULL);
+		wakeups += st[t].wakeups;
+		events += st[t].events;
+		spurious += st[t].spurious;
+		close(st[t].epfd);
+	}
+
+	printf("%s server %s, %d threads: %llu events, %llu wakeups, "
+	       "%.3f wakeups/event, %llu spurious\n",
+	       native ? "native" : "skip",
+	       mode == MODE_ET ? "et" : "excl", nthreads, events, wakeups,
+	       events ? (double)wakeups / events : 0, spurious);
+
+	close(fd);
+
+	return 0;
+}
+
+static int client(struct sockaddr_storage *saddr_s, socklen_t addrlen,
+		  struct sockaddr_storage *baddr_s, socklen_t baddrlen,
+		  int native, int nevents)
+{
+	int epfd, fd, n, ret, on = 1, *fds;
+	unsigned long long wakeups = 0, missed = 0, failed = 0;
+	struct epoll_event ev;
+	struct timespec start, end;
+	double sec;
+	char c = 'x';
+
+	fds = calloc(nconns, sizeof(*fds));
+	if (!fds) {
+		perror("calloc");
+		return -1;
+	}
+
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+
+	for (n = 0; n < nconns; n++) {
+		fds[n] = socket(native ? saddr_s->ss_family : AF_SKIP,
+				SOCK_STREAM, 0);
+		if (fds[n] < 0) {
+			perror("socket");
+			return -1;
+		}
+
+		/* before the host socket exists */
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = fds[n];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[n], &ev) < 0) {
+			perror("epoll_ctl");
+			return -1;
+		}
+
+		if (baddrlen && bind(fds[n], (struct sockaddr *)baddr_s,
+				     baddrlen) < 0) {
+			perror("bind");
+			return -1;
+		}
+
+		if (connect(fds[n], (struct sockaddr *)saddr_s,
+			    addrlen) < 0) {
+			perror("connect");
+			return -1;
+		}
+
+		setsockopt(fds[n], IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		fcntl(fds[n], F_SETFL, fcntl(fds[n], F_GETFL) | O_NONBLOCK);
+	}
+
+	srand(1);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (n = 0; n < nevents; n++) {
+		fd = fds[rand() % nconns];
+		if (write(fd, &c, 1) != 1) {
+			perror("write");
+			break;
+		}
+
+		ret = epoll_wait(epfd, &ev, 1, 1000);
+		if (ret < 0) {
+			perror("epoll_wait");
+			break;
+		}
+		if (ret)
+			wakeups++;
+
+		if (!ret || ev.data.fd != fd) {
+			/* check the echo has come without a wakeup */
+			missed++;
+			usleep(1000);
+		}
+
+		if (read(fd, &c, 1) != 1)
+			failed++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sec = elapsed(&start, &end);
+
+	printf("%s client: %d connections, %d events in %.3f sec, "
+	       "%llu wakeups, %llu missed, %llu lost\n",
+	       native ? "native" : "skip", nconns, n, sec, wakeups, missed,
+	       failed);
+
+	for (n = 0; n < nconns; n++)
+		close(fds[n]);
+	close(epfd);
+	free(fds);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int ch, port = 10000, native = 0, role = 0, mode = MODE_EXCL;
+	int nthreads = 4, nevents = 100000;
+	char *bind_addr = NULL;
+	socklen_t addrlen, baddrlen = 0;
+	struct sockaddr_storage saddr_s, baddr_s;
+
+	nconns = 2000;
+
+	while ((ch = getopt(argc, argv, "scte:T:n:m:B:p:h")) != -1) {
+		switch (ch) {
+		case 's':
+		case 'c':
+			role = ch;
+			break;
+		case 't':
+			native = 1;
+			break;
+		case 'e':
+			if (strcmp(optarg, "excl") == 0)
+				mode = MODE_EXCL;
+			else if (strcmp(optarg, "et") == 0)
+				mode = MODE_ET;
+			else {
+				usage();
+				return -1;
+			}
+			break;
+		case 'T':
+			nthreads = atoi(optarg);
+			break;
+		case 'n':
+			nconns = atoi(optarg);
+			break;
+		case 'm':
+			nevents = atoi(optarg);
+			break;
+		case 'B':
+			bind_addr = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (!role || optind >= argc || nconns < 1 || nevents < 1 ||
+	    nthreads < 1 || nthreads > THREADS_MAX) {
+		usage();
+		return -1;
+	}
+
+	if (parse_addr(argv[optind], port, &saddr_s, &addrlen) < 0)
+		return -1;
+	if (bind_addr && parse_addr(bind_addr, 0, &baddr_s, &baddrlen) < 0)
+		return -1;
+
+	raise_nofile(nconns);
+
+	if (role == 's')
+		return server(&saddr_s, addrlen, native, mode, nthreads);
+
+	return client(&saddr_s, addrlen, &baddr_s, baddrlen, native,
+		      nevents);
+}
@@ -0,0 +1,52 @@
+#!/bin/bash
+#
+# epoll wakeups per event over thousands of TCP connections between
+# two netns: native sockets on the host, AF_SKIP sockets over the
+# skip routes, and an AF_SKIP server bound to the wildcard address.
+# The server waits with EPOLLEXCLUSIVE on an epoll instance per
+# thread (excl), or with a single edge-triggered one (et). 1.000
+# wakeups/event and no missed wakeups are expected for all cases.
+
+. ./common.sh
+
+bench=./wakeup-bench
+nsa=skip-bench-a
+nsb=skip-bench-b
+conns=${CONNS:-2000}
+events=${EVENTS:-100000}
+port=10000
+
+make -s wakeup-bench || exit 1
+
+# setup test namespaces
+for ns in $nsa $nsb; do
+	netns_add $ns
+	skip_route $ns 172.16.0.0/16 127.0.0.1
+done
+
+run() {
+	# run NAME SERVER SERVER_OPTS SERVER_ADDR CLIENT CLIENT_OPTS
+	#     CLIENT_ADDR
+	echo wakeup-bench: $1
+	$2 $bench -s $3 -n $conns -p $port $4 &
+	sleep 0.5
+	$5 $bench -c $6 -n $conns -m $events -p $port $7
+	wait
+	port=$((port + 1))
+	echo
+}
+
+nsexeca="$ip netns exec $nsa"
+nsexecb="$ip netns exec $nsb"
+
+for mode in excl et; do
+	run "native on host, $mode" "" "-t -e $mode" 127.0.0.1 \
+		"" "-t" 127.0.0.1
+	run "skip, $mode" "$nsexeca" "-e $mode" 172.16.0.1 \
+		"$nsexecb" "-B 172.16.0.2" 127.0.0.1
+	run "skip wildcard, $mode" "$nsexeca" "-e $mode" 0.0.0.0 \
+		"$nsexecb" "-B 172.16.0.2" 127.0.0.1
+done
+
+
+netns_del $nsa $nsb